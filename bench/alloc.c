@@ -0,0 +1,101 @@
+/*
+ *  parse+release throughput of tutorial08 with malloc vs the bundled pool and slab allocators
+ *  build (from this directory):
+ *      gcc -O2 -DNDEBUG -I../tutorial08 ../tutorial08/leptjson.c corpus.c alloc.c -o alloc -lm
+ *  usage: ./alloc [-s scale] [-w warmup] [-r repetitions] [-j]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus.h"
+#include "leptjson.h"
+
+/* one timed pass: parse every document, then release them (lept_free or a pool reset) */
+static double run_once(const bench_corpus* c, lept_value* v, lept_pool* pool){
+    lept_parse_options opt = { 0 };
+    double t;
+    size_t i;
+    if (pool)
+        opt.allocator = lept_pool_allocator(pool);
+    t = bench_now();
+    for (i = 0; i < c->count; i++)
+        if (lept_parse_ex(&v[i], c->docs[i], &opt) != LEPT_PARSE_OK){
+            fprintf(stderr, "%s: document %zu failed to parse\n", c->name, i);
+            exit(1);
+        }
+    if (pool)
+        lept_pool_reset(pool);
+    else
+        for (i = 0; i < c->count; i++)
+            lept_free(&v[i]);
+    return bench_now() - t;
+}
+
+static int compare_double(const void* lhs, const void* rhs){
+    double a = *(const double*)lhs, b = *(const double*)rhs;
+    return (a > b) - (a < b);
+}
+
+int main(int argc, char* argv[]){
+    void (*gens[])(bench_corpus*, int) = { corpus_numbers, corpus_strings, corpus_nested, corpus_tiny };
+    static const char* names[] = { "malloc", "pool", "slab" };
+    int scale = 1, warmup = 2, reps = 10, json = 0, i, g, k;
+    double* samples;
+
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-j") == 0)
+            json = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            scale = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+            warmup = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            reps = atoi(argv[++i]);
+        else{
+            fprintf(stderr, "usage: %s [-s scale] [-w warmup] [-r repetitions] [-j]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (scale < 1 || warmup < 0 || reps < 1){
+        fprintf(stderr, "scale and repetitions must be positive\n");
+        return 1;
+    }
+    samples = (double*)malloc(reps * sizeof(double));
+    if (!json)
+        printf("%-8s %-8s %10s %8s %10s %10s %10s %12s\n", "corpus", "alloc", "bytes", "docs", "median ms", "p99 ms", "MB/s", "docs/s");
+
+    for (g = 0; g < (int)(sizeof(gens) / sizeof(gens[0])); g++){
+        bench_corpus c;
+        lept_value* v;
+        gens[g](&c, scale);
+        v = (lept_value*)malloc(c.count * sizeof(lept_value));
+        for (k = 0; k < 3; k++){
+            lept_pool* pool = k == 1 ? lept_pool_create(0) : NULL;
+            double median, p99;
+            lept_set_allocator(k == 2 ? lept_slab_allocator() : NULL);
+            for (i = 0; i < warmup; i++)
+                run_once(&c, v, pool);
+            for (i = 0; i < reps; i++)
+                samples[i] = run_once(&c, v, pool);
+            lept_pool_destroy(pool);
+            lept_slab_flush();
+            lept_set_allocator(NULL);
+            qsort(samples, reps, sizeof(double), compare_double);
+            median = reps % 2 ? samples[reps / 2] : (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+            p99 = samples[(reps * 99 + 99) / 100 - 1];
+            if (json)
+                printf("{\"corpus\":\"%s\",\"alloc\":\"%s\",\"bytes\":%zu,\"docs\":%zu,\"reps\":%d,"
+                    "\"median_ms\":%.4f,\"p99_ms\":%.4f,\"mb_per_s\":%.2f,\"docs_per_s\":%.0f}\n",
+                    c.name, names[k], c.bytes, c.count, reps,
+                    median * 1e3, p99 * 1e3, c.bytes / median / 1e6, c.count / median);
+            else
+                printf("%-8s %-8s %10zu %8zu %10.3f %10.3f %10.1f %12.0f\n",
+                    c.name, names[k], c.bytes, c.count,
+                    median * 1e3, p99 * 1e3, c.bytes / median / 1e6, c.count / median);
+        }
+        free(v);
+        corpus_free(&c);
+    }
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ *  parse / lazy-number parse / validate / stringify / equal / hash / free throughput of tutorial08 on generated corpora
+ *  build (from this directory):
+ *      gcc -O2 -DNDEBUG -I../tutorial08 ../tutorial08/leptjson.c corpus.c bench.c -o bench -lm
+ *  usage: ./bench [-s scale] [-w warmup] [-r repetitions] [-j]
+ *      -j prints one JSON object per line instead of the table
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus.h"
+#include "leptjson.h"
+
+typedef enum { OP_PARSE, OP_PARSE_LAZY, OP_VALIDATE, OP_STRINGIFY, OP_EQUAL, OP_HASH, OP_FREE, OP_COUNT } bench_op;
+static const char* op_names[] = { "parse", "parse-lazy", "validate", "stringify", "equal", "hash", "free" };
+
+typedef struct {
+    const bench_corpus* c;
+    lept_value* a;      // parsed corpus
+    lept_value* b;      // second copy for equal
+}bench_state;
+
+static void parse_all_ex(const bench_corpus* c, lept_value* v, const lept_parse_options* opt){
+    size_t i;
+    for (i = 0; i < c->count; i++)
+        if (lept_parse_ex(&v[i], c->docs[i], opt) != LEPT_PARSE_OK){
+            fprintf(stderr, "%s: document %zu failed to parse\n", c->name, i);
+            exit(1);
+        }
+}
+
+static void parse_all(const bench_corpus* c, lept_value* v){
+    parse_all_ex(c, v, NULL);
+}
+
+static void free_all(const bench_corpus* c, lept_value* v){
+    size_t i;
+    for (i = 0; i < c->count; i++)
+        lept_free(&v[i]);
+}
+
+/* one pass of op over the corpus, only the op itself is timed */
+static double run_once(bench_state* s, bench_op op){
+    const bench_corpus* c = s->c;
+    double t = 0;
+    lept_parse_options lazy = { 0 };
+    size_t i, length;
+    int equal = 1;
+    lazy.lazy_numbers = 1;
+    switch (op){
+        case OP_PARSE:
+            t = bench_now();
+            parse_all(c, s->a);
+            t = bench_now() - t;
+            free_all(c, s->a);
+            break;
+        case OP_PARSE_LAZY:
+            t = bench_now();
+            parse_all_ex(c, s->a, &lazy);
+            t = bench_now() - t;
+            free_all(c, s->a);
+            break;
+        case OP_VALIDATE:
+            t = bench_now();
+            for (i = 0; i < c->count; i++)
+                if (lept_validate(c->docs[i], c->lens[i], NULL) != LEPT_PARSE_OK){
+                    fprintf(stderr, "%s: document %zu failed to validate\n", c->name, i);
+                    exit(1);
+                }
+            t = bench_now() - t;
+            break;
+        case OP_STRINGIFY:
+            parse_all(c, s->a);
+            t = bench_now();
+            for (i = 0; i < c->count; i++)
+                free(lept_stringify(&s->a[i], &length));
+            t = bench_now() - t;
+            free_all(c, s->a);
+            break;
+        case OP_EQUAL:
+            parse_all(c, s->a);
+            parse_all(c, s->b);
+            t = bench_now();
+            for (i = 0; i < c->count; i++)
+                equal &= lept_is_equal(&s->a[i], &s->b[i]);
+            t = bench_now() - t;
+            free_all(c, s->a);
+            free_all(c, s->b);
+            if (!equal){
+                fprintf(stderr, "%s: copies compare unequal\n", c->name);
+                exit(1);
+            }
+            break;
+        case OP_HASH:
+            // cold: every container is hashed once, then hit in the cache
+            parse_all(c, s->a);
+            t = bench_now();
+            for (i = 0; i < c->count; i++)
+                equal += lept_hash(&s->a[i]) == lept_hash(&s->a[i]);
+            t = bench_now() - t;
+            free_all(c, s->a);
+            break;
+        case OP_FREE:
+            parse_all(c, s->a);
+            t = bench_now();
+            free_all(c, s->a);
+            t = bench_now() - t;
+            break;
+        default:
+            break;
+    }
+    return t;
+}
+
+static int compare_double(const void* lhs, const void* rhs){
+    double a = *(const double*)lhs, b = *(const double*)rhs;
+    return (a > b) - (a < b);
+}
+
+int main(int argc, char* argv[]){
+    void (*gens[])(bench_corpus*, int) = { corpus_numbers, corpus_strings, corpus_nested, corpus_tiny };
+    int scale = 1, warmup = 2, reps = 10, json = 0, i, g, op;
+    double* samples;
+
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-j") == 0)
+            json = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            scale = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+            warmup = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            reps = atoi(argv[++i]);
+        else{
+            fprintf(stderr, "usage: %s [-s scale] [-w warmup] [-r repetitions] [-j]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (scale < 1 || warmup < 0 || reps < 1){
+        fprintf(stderr, "scale and repetitions must be positive\n");
+        return 1;
+    }
+    samples = (double*)malloc(reps * sizeof(double));
+    if (!json)
+        printf("%-8s %-10s %10s %8s %10s %10s %10s %12s\n", "corpus", "op", "bytes", "docs", "median ms", "p99 ms", "MB/s", "docs/s");
+
+    for (g = 0; g < (int)(sizeof(gens) / sizeof(gens[0])); g++){
+        bench_corpus c;
+        bench_state s;
+        gens[g](&c, scale);
+        s.c = &c;
+        s.a = (lept_value*)malloc(c.count * sizeof(lept_value));
+        s.b = (lept_value*)malloc(c.count * sizeof(lept_value));
+        for (op = 0; op < OP_COUNT; op++){
+            double median, p99;
+            for (i = 0; i < warmup; i++)
+                run_once(&s, (bench_op)op);
+            for (i = 0; i < reps; i++)
+                samples[i] = run_once(&s, (bench_op)op);
+            qsort(samples, reps, sizeof(double), compare_double);
+            median = reps % 2 ? samples[reps / 2] : (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+            p99 = samples[(reps * 99 + 99) / 100 - 1];
+            if (json)
+                printf("{\"corpus\":\"%s\",\"op\":\"%s\",\"bytes\":%zu,\"docs\":%zu,\"reps\":%d,"
+                    "\"median_ms\":%.4f,\"p99_ms\":%.4f,\"mb_per_s\":%.2f,\"docs_per_s\":%.0f}\n",
+                    c.name, op_names[op], c.bytes, c.count, reps,
+                    median * 1e3, p99 * 1e3, c.bytes / median / 1e6, c.count / median);
+            else
+                printf("%-8s %-10s %10zu %8zu %10.3f %10.3f %10.1f %12.0f\n",
+                    c.name, op_names[op], c.bytes, c.count,
+                    median * 1e3, p99 * 1e3, c.bytes / median / 1e6, c.count / median);
+        }
+        free(s.a);
+        free(s.b);
+        corpus_free(&c);
+    }
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ *  CBOR decode vs JSON parse of the same documents, and the encoded size
+ *  build (from this directory):
+ *      gcc -O2 -DNDEBUG -I../tutorial08 ../tutorial08/leptjson.c corpus.c cbor.c -o cbor -lm
+ *  usage: ./cbor [-s scale] [-w warmup] [-r repetitions] [-j]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus.h"
+#include "leptjson.h"
+
+static int compare_double(const void* lhs, const void* rhs){
+    double a = *(const double*)lhs, b = *(const double*)rhs;
+    return (a > b) - (a < b);
+}
+
+static double median_of(double* samples, int reps){
+    qsort(samples, reps, sizeof(double), compare_double);
+    return reps % 2 ? samples[reps / 2] : (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+}
+
+int main(int argc, char* argv[]){
+    void (*gens[])(bench_corpus*, int) = { corpus_numbers, corpus_strings, corpus_nested, corpus_tiny };
+    int scale = 1, warmup = 2, reps = 10, json = 0, i, g;
+    double *parse_samples, *decode_samples;
+
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-j") == 0)
+            json = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            scale = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+            warmup = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            reps = atoi(argv[++i]);
+        else{
+            fprintf(stderr, "usage: %s [-s scale] [-w warmup] [-r repetitions] [-j]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (scale < 1 || warmup < 0 || reps < 1){
+        fprintf(stderr, "scale and repetitions must be positive\n");
+        return 1;
+    }
+    parse_samples = (double*)malloc(reps * sizeof(double));
+    decode_samples = (double*)malloc(reps * sizeof(double));
+    if (!json)
+        printf("%-8s %10s %10s %8s %10s %10s %8s\n", "corpus", "bytes", "cbor bytes", "docs", "parse ms", "decode ms", "speedup");
+
+    for (g = 0; g < (int)(sizeof(gens) / sizeof(gens[0])); g++){
+        bench_corpus c;
+        unsigned char** bin;
+        size_t* bin_len;
+        size_t k, cbor_bytes = 0;
+        lept_value v;
+        double parse_ms, decode_ms;
+        gens[g](&c, scale);
+        bin = (unsigned char**)malloc(c.count * sizeof(unsigned char*));
+        bin_len = (size_t*)malloc(c.count * sizeof(size_t));
+        for (k = 0; k < c.count; k++){
+            lept_init(&v);
+            if (lept_parse(&v, c.docs[k]) != LEPT_PARSE_OK){
+                fprintf(stderr, "%s: document %zu failed to parse\n", c.name, k);
+                return 1;
+            }
+            bin[k] = lept_cbor_encode(&v, &bin_len[k]);
+            cbor_bytes += bin_len[k];
+            lept_free(&v);
+        }
+        for (i = 0; i < warmup + reps; i++){
+            double t = bench_now();
+            for (k = 0; k < c.count; k++){
+                lept_parse(&v, c.docs[k]);
+                lept_free(&v);
+            }
+            t = bench_now() - t;
+            if (i >= warmup)
+                parse_samples[i - warmup] = t;
+            t = bench_now();
+            for (k = 0; k < c.count; k++){
+                lept_cbor_decode(&v, bin[k], bin_len[k]);
+                lept_free(&v);
+            }
+            t = bench_now() - t;
+            if (i >= warmup)
+                decode_samples[i - warmup] = t;
+        }
+        parse_ms = median_of(parse_samples, reps) * 1e3;
+        decode_ms = median_of(decode_samples, reps) * 1e3;
+        if (json)
+            printf("{\"corpus\":\"%s\",\"bytes\":%zu,\"cbor_bytes\":%zu,\"docs\":%zu,\"reps\":%d,"
+                "\"parse_ms\":%.4f,\"decode_ms\":%.4f}\n",
+                c.name, c.bytes, cbor_bytes, c.count, reps, parse_ms, decode_ms);
+        else
+            printf("%-8s %10zu %10zu %8zu %10.3f %10.3f %7.2fx\n",
+                c.name, c.bytes, cbor_bytes, c.count, parse_ms, decode_ms, parse_ms / decode_ms);
+        for (k = 0; k < c.count; k++)
+            free(bin[k]);
+        free(bin);
+        free(bin_len);
+        corpus_free(&c);
+    }
+    free(parse_samples);
+    free(decode_samples);
+    return 0;
+}
@@ -0,0 +1,220 @@
+#define _POSIX_C_SOURCE 199309L
+#include "corpus.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    char* s;
+    size_t size, top;
+}bench_buf;
+
+static unsigned int seed = 2463534242u;
+
+/* xorshift, same sequence on every run */
+static unsigned int rnd(unsigned int n){
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % n;
+}
+
+static void buf_printf(bench_buf* b, const char* fmt, ...){
+    va_list ap;
+    int n;
+    for (;;){
+        va_start(ap, fmt);
+        n = vsnprintf(b->s + b->top, b->size - b->top, fmt, ap);
+        va_end(ap);
+        if ((size_t)n < b->size - b->top)
+            break;
+        b->size = (b->size + n) * 2;
+        b->s = (char*)realloc(b->s, b->size);
+    }
+    b->top += n;
+}
+
+static void corpus_init(bench_corpus* c, const char* name, size_t count){
+    c->name = name;
+    c->docs = (char**)malloc(count * sizeof(char*));
+    c->lens = (size_t*)malloc(count * sizeof(size_t));
+    c->count = c->bytes = 0;
+    seed = 2463534242u;
+}
+
+static void corpus_add(bench_corpus* c, bench_buf* b){
+    c->docs[c->count] = b->s;
+    c->lens[c->count++] = b->top;
+    c->bytes += b->top;
+    b->s = NULL;
+    b->size = b->top = 0;
+}
+
+static void corpus_one(bench_corpus* c, const char* name, bench_buf* b){
+    corpus_init(c, name, 1);
+    corpus_add(c, b);
+}
+
+void corpus_numbers(bench_corpus* c, int scale){
+    bench_buf b = { NULL, 0, 0 };
+    int i, j, rings = 480 * scale;
+    buf_printf(&b, "{\"type\":\"FeatureCollection\",\"features\":[{\"type\":\"Feature\","
+        "\"properties\":{\"name\":\"Canada\"},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[");
+    for (i = 0; i < rings; i++){
+        buf_printf(&b, "%s[", i ? "," : "");
+        for (j = 0; j < 120; j++)
+            buf_printf(&b, "%s[%.14g,%.14g]", j ? "," : "",
+                -141.0 + rnd(8000000) * 1e-5 + rnd(1000) * 1e-11, 41.0 + rnd(4200000) * 1e-5 + rnd(1000) * 1e-11);
+        buf_printf(&b, "]");
+    }
+    buf_printf(&b, "]}}]}");
+    corpus_one(c, "numbers", &b);
+}
+
+void corpus_arrays(bench_corpus* c, int scale){
+    bench_buf b = { NULL, 0, 0 };
+    int i, j, rings = 480 * scale;
+    buf_printf(&b, "[");
+    for (i = 0; i < rings; i++){
+        buf_printf(&b, "%s[", i ? "," : "");
+        for (j = 0; j < 120; j++)
+            buf_printf(&b, "%s[%.14g,%.14g]", j ? "," : "",
+                -141.0 + rnd(8000000) * 1e-5 + rnd(1000) * 1e-11, 41.0 + rnd(4200000) * 1e-5 + rnd(1000) * 1e-11);
+        buf_printf(&b, "]");
+    }
+    buf_printf(&b, "]");
+    corpus_one(c, "arrays", &b);
+}
+
+void corpus_strings(bench_corpus* c, int scale){
+    static const char* texts[] = {
+        "RT @Foo: \\u3053\\u3093\\u306b\\u3061\\u306f\\u3001\\u4e16\\u754c\\uff01 #bench http://t.co/abc123",
+        "\xe4\xbb\x8a\xe6\x97\xa5\xe3\x81\xaf\xe3\x81\x84\xe3\x81\x84\xe5\xa4\xa9\xe6\xb0\x97\xe3\x81\xa7\xe3\x81\x99\xe3\x81\xad\\n\xe6\x95\xa3\xe6\xad\xa9\xe3\x81\x97\xe3\x82\x88\xe3\x81\x86",
+        "Quote: \\\"to be or not to be\\\"\\nthat is the question \\ud83d\\ude00\\ud83c\\udf89",
+        "plain ascii status text with a link https:\\/\\/example.com\\/path?q=1&r=2 and some more words",
+        "Caf\xc3\xa9 cr\xc3\xa8me br\xc3\xbbl\xc3\xa9" "e \xe2\x80\x94 na\xc3\xafve r\xc3\xa9sum\xc3\xa9 \\t tab \\u00e9\\u00e8"
+    };
+    bench_buf b = { NULL, 0, 0 };
+    int i, n = 1600 * scale;
+    buf_printf(&b, "{\"statuses\":[");
+    for (i = 0; i < n; i++){
+        unsigned int id = 505874900 + i;
+        buf_printf(&b, "%s{\"metadata\":{\"result_type\":\"recent\",\"iso_language_code\":\"ja\"},"
+            "\"created_at\":\"Sun Aug 31 00:29:15 +0000 2014\",\"id\":%u,\"id_str\":\"%u\",\"text\":\"%s\","
+            "\"source\":\"<a href=\\\"https://mobile.twitter.com\\\" rel=\\\"nofollow\\\">Mobile Web</a>\","
+            "\"truncated\":false,\"in_reply_to_status_id\":null,"
+            "\"user\":{\"id\":%u,\"name\":\"\\u30e6\\u30fc\\u30b6\\u30fc%d\",\"screen_name\":\"user_%d\","
+            "\"description\":\"%s\",\"followers_count\":%u,\"verified\":%s},"
+            "\"entities\":{\"hashtags\":[{\"text\":\"bench\",\"indices\":[%u,%u]}],\"urls\":[],\"user_mentions\":[]},"
+            "\"retweet_count\":%u,\"favorite_count\":%u,\"favorited\":false,\"retweeted\":false,\"lang\":\"ja\"}",
+            i ? "," : "", id, id, texts[rnd(5)], rnd(100000000), i, i, texts[rnd(5)], rnd(100000),
+            rnd(2) ? "true" : "false", rnd(50), 50 + rnd(50), rnd(1000), rnd(1000));
+    }
+    buf_printf(&b, "]}");
+    corpus_one(c, "strings", &b);
+}
+
+void corpus_nested(bench_corpus* c, int scale){
+    bench_buf b = { NULL, 0, 0 };
+    int i, j, n = 800 * scale;
+    buf_printf(&b, "{\"areaNames\":{");
+    for (i = 0; i < 200; i++)
+        buf_printf(&b, "%s\"%u\":\"Arri\\u00e8re-sc\\u00e8ne %d\"", i ? "," : "", 205705993 + i, i);
+    buf_printf(&b, "},\"events\":{");
+    for (i = 0; i < n; i++){
+        buf_printf(&b, "%s\"%u\":{\"description\":null,\"id\":%u,\"logo\":null,\"name\":\"Event %d\","
+            "\"subTopicIds\":[337184269,337184283],\"subjectCode\":null,\"subtitle\":null,\"topicIds\":[324846099,107888604]}",
+            i ? "," : "", 138586341 + i, 138586341 + i, i);
+    }
+    buf_printf(&b, "},\"performances\":[");
+    for (i = 0; i < n; i++){
+        buf_printf(&b, "%s{\"eventId\":%u,\"id\":%u,\"logo\":null,\"name\":null,\"prices\":[", i ? "," : "", 138586341 + i, 339887544 + i);
+        for (j = 0; j < 3; j++)
+            buf_printf(&b, "%s{\"amount\":%u,\"audienceSubCategoryId\":337100890,\"seatCategoryId\":%u}", j ? "," : "", 10000 + rnd(90000), 338937295 + j);
+        buf_printf(&b, "],\"seatCategories\":[{\"areas\":[{\"areaId\":205705999,\"blockIds\":[]},{\"areaId\":205705998,\"blockIds\":[]}],"
+            "\"seatCategoryId\":338937295}],\"seatMapImage\":null,\"start\":%u000,\"venueCode\":\"PLEYEL_PLEYEL\"}", 1372608000u + i);
+    }
+    buf_printf(&b, "],\"deep\":");
+    for (i = 0; i < 256; i++)
+        buf_printf(&b, i % 2 ? "[" : "{\"d\":");
+    buf_printf(&b, "0");
+    for (i = 255; i >= 0; i--)
+        buf_printf(&b, i % 2 ? "]" : "}");
+    buf_printf(&b, "}");
+    corpus_one(c, "nested", &b);
+}
+
+void corpus_tiny(bench_corpus* c, int scale){
+    bench_buf b = { NULL, 0, 0 };
+    int i, n = 40000 * scale;
+    corpus_init(c, "tiny", n);
+    for (i = 0; i < n; i++){
+        buf_printf(&b, "{\"id\":%d,\"ok\":%s,\"score\":%.3f,\"tag\":\"t%u\",\"v\":[%u,%u]}",
+            i, rnd(2) ? "true" : "false", rnd(100000) / 7.0, rnd(1000), rnd(100), rnd(100));
+        corpus_add(c, &b);
+    }
+}
+
+void corpus_literals(bench_corpus* c, int scale){
+    static const char* lits[] = { "null", " true", "false ", "\ttrue\n" };
+    bench_buf b = { NULL, 0, 0 };
+    int i, n = 100000 * scale;
+    corpus_init(c, "literals", n);
+    for (i = 0; i < n; i++){
+        buf_printf(&b, "%s", lits[rnd(4)]);
+        corpus_add(c, &b);
+    }
+}
+
+void corpus_scalar_numbers(bench_corpus* c, int scale){
+    bench_buf b = { NULL, 0, 0 };
+    int i, n = 100000 * scale;
+    corpus_init(c, "scalar_numbers", n);
+    for (i = 0; i < n; i++){
+        switch (rnd(3)){
+            case 0:  buf_printf(&b, "%u", rnd(1000000)); break;
+            case 1:  buf_printf(&b, "%.17g", (rnd(2000000) - 1000000.0) / 3.0); break;
+            default: buf_printf(&b, "%.6e", rnd(1000000) * 1e-3); break;
+        }
+        corpus_add(c, &b);
+    }
+}
+
+void corpus_scalar_strings(bench_corpus* c, int scale){
+    bench_buf b = { NULL, 0, 0 };
+    int i, n = 100000 * scale;
+    corpus_init(c, "scalar_strings", n);
+    for (i = 0; i < n; i++){
+        buf_printf(&b, "\"user_%u said \\\"hello\\\"\\tand left a path C:\\\\tmp\\\\%u\\n\"", rnd(100000), rnd(1000));
+        corpus_add(c, &b);
+    }
+}
+
+void corpus_scalar_unicode(bench_corpus* c, int scale){
+    bench_buf b = { NULL, 0, 0 };
+    int i, n = 100000 * scale;
+    corpus_init(c, "scalar_unicode", n);
+    for (i = 0; i < n; i++){
+        buf_printf(&b, "\"\\u3053\\u3093\\u306b\\u3061\\u306f %u \\u00e9\\u00e8 \\ud83d\\ude00\\ud834\\udd1e\"", rnd(100000));
+        corpus_add(c, &b);
+    }
+}
+
+void corpus_free(bench_corpus* c){
+    size_t i;
+    for (i = 0; i < c->count; i++)
+        free(c->docs[i]);
+    free(c->docs);
+    free(c->lens);
+    c->docs = NULL;
+    c->lens = NULL;
+    c->count = c->bytes = 0;
+}
+
+double bench_now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,31 @@
+#ifndef BENCH_CORPUS_H__
+#define BENCH_CORPUS_H__
+
+#include <stddef.h>
+
+/* generated, deterministic inputs; a corpus is a set of NUL-terminated documents */
+typedef struct {
+	const char* name;
+	char** docs;
+	size_t* lens;
+	size_t count, bytes;
+}bench_corpus;
+
+/* document shapes after the usual benchmark files, scale 1 is ~2MB each */
+void corpus_numbers(bench_corpus* c, int scale);	// canada.json: coordinate arrays
+void corpus_strings(bench_corpus* c, int scale);	// twitter.json: text, unicode, escapes
+void corpus_nested(bench_corpus* c, int scale);		// citm_catalog.json: wide objects, deep nesting
+void corpus_tiny(bench_corpus* c, int scale);		// many small objects
+
+/* restricted shapes, for the early snapshots that don't parse every kind of value yet */
+void corpus_literals(bench_corpus* c, int scale);	// null, true, false
+void corpus_scalar_numbers(bench_corpus* c, int scale);
+void corpus_scalar_strings(bench_corpus* c, int scale);	// ASCII with simple escapes
+void corpus_scalar_unicode(bench_corpus* c, int scale);	// \uXXXX escapes and surrogate pairs
+void corpus_arrays(bench_corpus* c, int scale);		// corpus_numbers' coordinates without the objects
+
+void corpus_free(bench_corpus* c);
+
+double bench_now();
+
+#endif
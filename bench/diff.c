@@ -0,0 +1,143 @@
+/*
+ *  lept_diff on documents with small deltas: patch size and time vs shipping the whole document
+ *  build (from this directory):
+ *      gcc -O2 -DNDEBUG -I../tutorial08 ../tutorial08/leptjson.c corpus.c diff.c -o diff -lm
+ *  usage: ./diff [-s scale] [-w warmup] [-r repetitions] [-d deltas] [-j]
+ *      -d is the number of values changed per document (default 3)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus.h"
+#include "leptjson.h"
+
+static unsigned int seed = 88172645u;
+
+static unsigned int rnd(unsigned int n){
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % n;
+}
+
+/* walks down a random path and changes what it ends on, arrays sometimes get an element */
+static void mutate(lept_value* v){
+    for (;;){
+        if (lept_get_type(v) == LEPT_ARRAY && lept_get_array_size(v) > 0){
+            if (rnd(8) == 0){
+                lept_set_string(lept_insert_array_element(v, rnd((unsigned)lept_get_array_size(v))), "inserted", 8);
+                return;
+            }
+            v = lept_get_array_element(v, rnd((unsigned)lept_get_array_size(v)));
+        }else if (lept_get_type(v) == LEPT_OBJECT && lept_get_object_size(v) > 0)
+            v = lept_get_object_value(v, rnd((unsigned)lept_get_object_size(v)));
+        else
+            break;
+    }
+    if (lept_get_type(v) == LEPT_NUMBER)
+        lept_set_number(v, lept_get_number(v) + 1);
+    else
+        lept_set_string(v, "changed", 7);
+}
+
+static int compare_double(const void* lhs, const void* rhs){
+    double a = *(const double*)lhs, b = *(const double*)rhs;
+    return (a > b) - (a < b);
+}
+
+static double median_of(double* samples, int reps){
+    qsort(samples, reps, sizeof(double), compare_double);
+    return reps % 2 ? samples[reps / 2] : (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+}
+
+int main(int argc, char* argv[]){
+    void (*gens[])(bench_corpus*, int) = { corpus_numbers, corpus_strings, corpus_nested, corpus_tiny };
+    int scale = 1, warmup = 2, reps = 10, deltas = 3, json = 0, i, g;
+    double *diff_samples, *stringify_samples;
+
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-j") == 0)
+            json = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            scale = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+            warmup = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            reps = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-d") == 0)
+            deltas = atoi(argv[++i]);
+        else{
+            fprintf(stderr, "usage: %s [-s scale] [-w warmup] [-r repetitions] [-d deltas] [-j]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (scale < 1 || warmup < 0 || reps < 1 || deltas < 0){
+        fprintf(stderr, "scale and repetitions must be positive\n");
+        return 1;
+    }
+    diff_samples = (double*)malloc(reps * sizeof(double));
+    stringify_samples = (double*)malloc(reps * sizeof(double));
+    if (!json)
+        printf("%-8s %10s %8s %12s %12s %12s\n", "corpus", "bytes", "docs", "patch bytes", "diff ms", "stringify ms");
+
+    for (g = 0; g < (int)(sizeof(gens) / sizeof(gens[0])); g++){
+        bench_corpus c;
+        lept_value *a, *b, patch;
+        size_t k, length, patch_bytes = 0;
+        double diff_ms, stringify_ms;
+        gens[g](&c, scale);
+        a = (lept_value*)malloc(c.count * sizeof(lept_value));
+        b = (lept_value*)malloc(c.count * sizeof(lept_value));
+        for (k = 0; k < c.count; k++){
+            lept_init(&a[k]);
+            lept_init(&b[k]);
+            if (lept_parse(&a[k], c.docs[k]) != LEPT_PARSE_OK){
+                fprintf(stderr, "%s: document %zu failed to parse\n", c.name, k);
+                return 1;
+            }
+            lept_copy(&b[k], &a[k]);
+            for (i = 0; i < deltas; i++)
+                mutate(&b[k]);
+        }
+        lept_init(&patch);
+        for (k = 0; k < c.count; k++){
+            lept_diff(&patch, &a[k], &b[k]);
+            free(lept_stringify(&patch, &length));
+            patch_bytes += length;
+        }
+        for (i = 0; i < warmup + reps; i++){
+            double t = bench_now();
+            for (k = 0; k < c.count; k++)
+                lept_diff(&patch, &a[k], &b[k]);
+            t = bench_now() - t;
+            if (i >= warmup)
+                diff_samples[i - warmup] = t;
+            t = bench_now();
+            for (k = 0; k < c.count; k++)
+                free(lept_stringify(&b[k], &length));
+            t = bench_now() - t;
+            if (i >= warmup)
+                stringify_samples[i - warmup] = t;
+        }
+        diff_ms = median_of(diff_samples, reps) * 1e3;
+        stringify_ms = median_of(stringify_samples, reps) * 1e3;
+        if (json)
+            printf("{\"corpus\":\"%s\",\"bytes\":%zu,\"docs\":%zu,\"deltas\":%d,\"reps\":%d,"
+                "\"patch_bytes\":%zu,\"diff_ms\":%.4f,\"stringify_ms\":%.4f}\n",
+                c.name, c.bytes, c.count, deltas, reps, patch_bytes, diff_ms, stringify_ms);
+        else
+            printf("%-8s %10zu %8zu %12zu %12.3f %12.3f\n",
+                c.name, c.bytes, c.count, patch_bytes, diff_ms, stringify_ms);
+        lept_free(&patch);
+        for (k = 0; k < c.count; k++){
+            lept_free(&a[k]);
+            lept_free(&b[k]);
+        }
+        free(a);
+        free(b);
+        corpus_free(&c);
+    }
+    free(diff_samples);
+    free(stringify_samples);
+    return 0;
+}
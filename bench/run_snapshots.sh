@@ -0,0 +1,27 @@
+#!/bin/sh
+# builds snapshots.c against tutorial01..tutorial08 and prints one report
+# extra arguments are directories of other engines with the tutorial08 API, compared after tutorial08
+# CC, CFLAGS and BENCH_FLAGS (passed to every driver, e.g. "-j -r 5") can be set in the environment
+# allocation counting relies on GNU ld's --wrap
+set -e
+cd "$(dirname "$0")"
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2 -DNDEBUG}
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+header=
+run() {
+    name=$(basename "$1")
+    $CC $CFLAGS -DLEPT_TUTORIAL="$2" -I"$1" "$1/leptjson.c" corpus.c snapshots.c -o "$out/$name" -lm \
+        -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc,--wrap=free
+    "$out/$name" -n "$name" $header $BENCH_FLAGS
+    header=-H
+}
+
+for i in 1 2 3 4 5 6 7 8; do
+    run ../tutorial0$i $i
+done
+for dir in "$@"; do
+    run "$dir" 8
+done
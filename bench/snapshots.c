@@ -0,0 +1,154 @@
+/*
+ *  lept_parse throughput and allocation count of one tutorial snapshot
+ *  LEPT_TUTORIAL is the snapshot number and decides which corpora it can parse:
+ *      1 literals, 2 numbers, 3 strings, 4 \u escapes, 5 arrays, 6 and later objects
+ *  an engine with the tutorial08 API is built with LEPT_TUTORIAL=8.
+ *  allocations are counted by wrapping the allocator at link time (GNU ld):
+ *      gcc -O2 -DNDEBUG -DLEPT_TUTORIAL=5 -I../tutorial05 ../tutorial05/leptjson.c corpus.c snapshots.c \
+ *          -o snapshot05 -lm -Wl,--wrap=malloc,--wrap=realloc,--wrap=calloc,--wrap=free
+ *  run_snapshots.sh does this for every snapshot and prints one report.
+ *  usage: ./snapshot05 [-n name] [-s scale] [-w warmup] [-r repetitions] [-j] [-H]
+ *      -j prints one JSON object per line, -H leaves out the table header
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpus.h"
+#include "leptjson.h"
+
+#ifndef LEPT_TUTORIAL
+#define LEPT_TUTORIAL 8
+#endif
+
+void* __real_malloc(size_t size);
+void* __real_realloc(void* p, size_t size);
+void* __real_calloc(size_t n, size_t size);
+void __real_free(void* p);
+
+static size_t allocs, frees;
+
+void* __wrap_malloc(size_t size){ allocs++; return __real_malloc(size); }
+void* __wrap_realloc(void* p, size_t size){ allocs++; return __real_realloc(p, size); }
+void* __wrap_calloc(size_t n, size_t size){ allocs++; return __real_calloc(n, size); }
+void __wrap_free(void* p){ if (p) frees++; __real_free(p); }
+
+static void release(lept_value* v){
+#if LEPT_TUTORIAL >= 3
+    lept_free(v);
+#else
+    (void)v;    // nothing is allocated before strings
+#endif
+}
+
+/* one timed pass, 0 if a document fails to parse */
+static double run_once(const bench_corpus* c, lept_value* v, size_t* n){
+    double t;
+    size_t i;
+    int ok = 1;
+    allocs = 0;
+    t = bench_now();
+    for (i = 0; i < c->count; i++){
+        v[i].type = LEPT_NULL;
+        ok &= lept_parse(&v[i], c->docs[i]) == LEPT_PARSE_OK;
+    }
+    t = bench_now() - t;
+    *n = allocs;
+    for (i = 0; i < c->count; i++)
+        release(&v[i]);
+    return ok ? t : 0;
+}
+
+static int compare_double(const void* lhs, const void* rhs){
+    double a = *(const double*)lhs, b = *(const double*)rhs;
+    return (a > b) - (a < b);
+}
+
+int main(int argc, char* argv[]){
+    void (*gens[])(bench_corpus*, int) = {
+        corpus_literals,
+#if LEPT_TUTORIAL >= 2
+        corpus_scalar_numbers,
+#endif
+#if LEPT_TUTORIAL >= 3
+        corpus_scalar_strings,
+#endif
+#if LEPT_TUTORIAL >= 4
+        corpus_scalar_unicode,
+#endif
+#if LEPT_TUTORIAL >= 5
+        corpus_arrays,
+#endif
+#if LEPT_TUTORIAL >= 6
+        corpus_numbers, corpus_strings, corpus_nested, corpus_tiny,
+#endif
+    };
+    const char* name = "tutorial";
+    int scale = 1, warmup = 2, reps = 10, json = 0, header = 1, i, g;
+    double* samples;
+
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "-j") == 0)
+            json = 1;
+        else if (strcmp(argv[i], "-H") == 0)
+            header = 0;
+        else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+            name = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            scale = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+            warmup = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            reps = atoi(argv[++i]);
+        else{
+            fprintf(stderr, "usage: %s [-n name] [-s scale] [-w warmup] [-r repetitions] [-j] [-H]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (scale < 1 || warmup < 0 || reps < 1){
+        fprintf(stderr, "scale and repetitions must be positive\n");
+        return 1;
+    }
+    samples = (double*)malloc(reps * sizeof(double));
+    if (!json && header)
+        printf("%-12s %-15s %10s %8s %10s %10s %10s %12s %12s\n",
+            "engine", "corpus", "bytes", "docs", "median ms", "p99 ms", "MB/s", "docs/s", "allocs/doc");
+
+    for (g = 0; g < (int)(sizeof(gens) / sizeof(gens[0])); g++){
+        bench_corpus c;
+        lept_value* v;
+        double median, p99;
+        size_t n = 0;
+        int failed = 0;
+        gens[g](&c, scale);
+        v = (lept_value*)malloc(c.count * sizeof(lept_value));
+        for (i = 0; i < warmup + reps && !failed; i++){
+            double t = run_once(&c, v, &n);
+            failed = t == 0;
+            if (i >= warmup)
+                samples[i - warmup] = t;
+        }
+        if (failed){
+            if (json)
+                printf("{\"engine\":\"%s\",\"corpus\":\"%s\",\"error\":\"parse failed\"}\n", name, c.name);
+            else
+                printf("%-12s %-15s parse failed\n", name, c.name);
+        }else{
+            qsort(samples, reps, sizeof(double), compare_double);
+            median = reps % 2 ? samples[reps / 2] : (samples[reps / 2 - 1] + samples[reps / 2]) / 2;
+            p99 = samples[(reps * 99 + 99) / 100 - 1];
+            if (json)
+                printf("{\"engine\":\"%s\",\"corpus\":\"%s\",\"bytes\":%zu,\"docs\":%zu,\"reps\":%d,\"median_ms\":%.4f,"
+                    "\"p99_ms\":%.4f,\"mb_per_s\":%.2f,\"docs_per_s\":%.0f,\"allocs\":%zu}\n",
+                    name, c.name, c.bytes, c.count, reps, median * 1e3, p99 * 1e3,
+                    c.bytes / median / 1e6, c.count / median, n);
+            else
+                printf("%-12s %-15s %10zu %8zu %10.3f %10.3f %10.1f %12.0f %12.2f\n",
+                    name, c.name, c.bytes, c.count, median * 1e3, p99 * 1e3,
+                    c.bytes / median / 1e6, c.count / median, (double)n / c.count);
+        }
+        free(v);
+        corpus_free(&c);
+    }
+    free(samples);
+    return 0;
+}
@@ -1,14 +1,62 @@
+/* before any header: fdopen, mmap's MAP_ANONYMOUS and madvise aren't declared in strict -std=c99 mode */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#define _DARWIN_C_SOURCE
+#endif
+
 #include "leptjson.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <math.h>
+#include <float.h>
+#include <limits.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define LEPT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#elif !defined(MAP_ANONYMOUS)
+#undef LEPT_HAVE_MMAP     // no anonymous mappings to pad the file with: read it through stdio
+#endif
+#endif
+
+#ifdef LEPT_PARSE_STATS
+#include <time.h>
+#endif
+
 #ifndef LEPT_PARSE_STACK_INIT_SIZE
 #define LEPT_PARSE_STACK_INIT_SIZE 256
 #endif
 
+#ifndef LEPT_OBJECT_INDEX_THRESHOLD
+#define LEPT_OBJECT_INDEX_THRESHOLD 16     // objects this big get a key hash index
+#endif
+
+/* per-call state (allocator override) is thread-local where the compiler supports it */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define LEPT_THREAD_LOCAL _Thread_local
+#define LEPT_HAVE_THREAD_LOCAL
+#elif defined(__GNUC__)
+#define LEPT_THREAD_LOCAL __thread
+#define LEPT_HAVE_THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define LEPT_THREAD_LOCAL __declspec(thread)
+#define LEPT_HAVE_THREAD_LOCAL
+#else
+#define LEPT_THREAD_LOCAL
+#endif
+
 #ifndef LEOT_PARSE_STRINGIFY_INIT_SIZE
 #define LEPT_PARSE_STRINGIFY_INIT_SIZE 256
 #endif
@@ -25,9 +73,489 @@ typedef struct {
     const char* json;
     char* stack;
     size_t size, top;
+    const lept_allocator* a;    // owns the stack
+    int strict_utf8;            // parsing: strings must be well-formed UTF-8
+    int lazy_numbers;           // parsing: keep short number text, see LEPT_FLAG_RAW_NUMBER
+    const char* end;            // parsing: the terminating NUL, found on the first lept_skip_value()
+#ifdef LEPT_PARSE_STATS
+    lept_parse_stats* stats;    // NULL: not collecting
+    size_t depth;
+#endif
 }lept_context;
 
+/*
+ *  counters, every LEPT_STAT_* is a no-op unless built with LEPT_PARSE_STATS
+ */
+#ifdef LEPT_PARSE_STATS
+#define LEPT_CONTEXT_STATS(c, s) do { (c)->stats = (s); (c)->depth = 0; } while(0)
+#define LEPT_STAT_ADD(c, field, n) do { if ((c)->stats) (c)->stats->field += (n); } while(0)
+#define LEPT_STAT_MAX(c, field, n) do { if ((c)->stats && (c)->stats->field < (n)) (c)->stats->field = (n); } while(0)
+#define LEPT_STAT_ENTER(c) do { if ((c)->stats) { (c)->depth++; LEPT_STAT_MAX(c, max_depth, (c)->depth); } } while(0)
+#define LEPT_STAT_LEAVE(c, v, ret) do { if ((c)->stats) { (c)->depth--; if ((ret) == LEPT_PARSE_OK) (c)->stats->values[(v)->type]++; } } while(0)
+#define LEPT_STAT_TIME(t) double t = lept_stats_now()
+#define LEPT_STAT_ELAPSED(c, field, t) LEPT_STAT_ADD(c, field, lept_stats_now() - (t))
+
+static double lept_stats_now(){
+#ifdef LEPT_HAVE_MMAP
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+#else
+#define LEPT_CONTEXT_STATS(c, s) do { (void)(s); } while(0)
+#define LEPT_STAT_ADD(c, field, n) do {} while(0)
+#define LEPT_STAT_MAX(c, field, n) do {} while(0)
+#define LEPT_STAT_ENTER(c) do {} while(0)
+#define LEPT_STAT_LEAVE(c, v, ret) do {} while(0)
+#define LEPT_STAT_TIME(t) do {} while(0)
+#define LEPT_STAT_ELAPSED(c, field, t) do {} while(0)
+#endif
+
+/*
+ *  open addressing (linear probing) table: key -> member index,
+ *  pos is member index + 1, 0 marks an empty slot
+ */
+typedef struct {
+    size_t hash, pos;
+}lept_slot;
+
+typedef struct {
+    size_t mask;        // slots - 1, slots is a power of 2
+    int dup;            // built from an object with duplicated keys
+    lept_slot slot[];
+}lept_index;
+
+/*
+ *  array elements / object members are preceded by a header holding the capacity,
+ *  so lept_value itself doesn't grow (see LEPT_COMPACT_VALUE)
+ */
+typedef struct {
+    size_t capacity;
+    lept_index* index;  // objects only, built lazily by lept_find_object_index() or by lept_build_index()
+    const lept_allocator* a;    // the block and its index came from here
+    size_t hash;        // lept_hash() of the array/object if hash_state is LEPT_HASH_CACHED
+    int hash_state;
+}lept_header;
+
+#define LEPT_HEADER(p) ((lept_header*)(p) - 1)
+
+/*
+ *  values don't know their parent, so a change deep down a tree can't reach the hashes cached
+ *  above it. instead a block is opened for good as soon as a pointer into it is handed out or
+ *  its content changes: every path to a value inside a document opens all the containers on
+ *  the way, and opened blocks never cache again. untouched documents keep their hashes.
+ */
+#define LEPT_HASH_NONE      0
+#define LEPT_HASH_CACHED    1
+#define LEPT_HASH_OPEN      2
+
+static void lept_hash_open(const lept_value* v){
+    lept_header* h = NULL;
+    if (v->type == LEPT_ARRAY && v->u.a.e != NULL)
+        h = LEPT_HEADER(v->u.a.e);
+    else if (v->type == LEPT_OBJECT && v->u.o.m != NULL)
+        h = LEPT_HEADER(v->u.o.m);
+    if (h != NULL && h->hash_state != LEPT_HASH_OPEN)   // read-only once open
+        h->hash_state = LEPT_HASH_OPEN;
+}
+
+/* one reference token of a JSON Pointer / path */
+typedef struct {
+    const char* key;
+    size_t klen;
+    size_t hash;
+    size_t index;       // array index, LEPT_KEY_NOT_EXIST if the token isn't one
+}lept_token;
+
+struct lept_pointer {
+    size_t n;
+    lept_token* t;
+};
+
 static int lept_parse_value(lept_context* c, lept_value* v);
+static void lept_stringify_string(lept_context* c, const char* s, size_t len);
+static void lept_stringify_value(lept_context* c, const lept_value* v);
+
+
+/* FNV-1a */
+static size_t lept_hash_key(const char* key, size_t klen){
+    size_t i;
+    unsigned long long h = 14695981039346656037ULL;
+    for (i = 0; i < klen; i++){
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+    return (size_t)h;
+}
+
+/*
+ *  allocator
+ *  memory owned by values (strings, keys, element/member blocks, key indexes) and the parse stack
+ *  comes from the per-call allocator (lept_parse_ex, lept_free_ex) if there is one, else the global
+ *  one. it's only current for that call, so what outlives it remembers where it came from: blocks
+ *  in their header, heap strings in front of the text, keys belong to their object's block.
+ */
+static void* lept_std_alloc(void* ud, size_t size){ (void)ud; return malloc(size); }
+static void* lept_std_realloc(void* ud, void* p, size_t size){ (void)ud; return realloc(p, size); }
+static void lept_std_free(void* ud, void* p){ (void)ud; free(p); }
+
+static const lept_allocator lept_std_allocator = { lept_std_alloc, lept_std_realloc, lept_std_free, NULL };
+static const lept_allocator* lept_global_allocator = &lept_std_allocator;
+static LEPT_THREAD_LOCAL const lept_allocator* lept_scoped_allocator = NULL;
+
+void lept_set_allocator(const lept_allocator* a){
+    lept_global_allocator = a != NULL ? a : &lept_std_allocator;
+}
+
+const lept_allocator* lept_get_allocator(){
+    return lept_global_allocator;
+}
+
+static const lept_allocator* lept_current_allocator(){
+    return lept_scoped_allocator != NULL ? lept_scoped_allocator : lept_global_allocator;
+}
+
+/* memory that doesn't leave the call, e.g. keys still on the parse stack */
+static void* lept_mem_alloc(size_t size){
+    const lept_allocator* a = lept_current_allocator();
+    return a->alloc(a->ud, size);
+}
+
+static void lept_mem_free(void* p){
+    const lept_allocator* a = lept_current_allocator();
+    if (p)
+        a->free(a->ud, p);
+}
+
+/* pool: chunks of bump-allocated blocks, each block is preceded by its size */
+#ifndef LEPT_POOL_CHUNK_SIZE
+#define LEPT_POOL_CHUNK_SIZE (64 * 1024)
+#endif
+
+#define LEPT_POOL_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+typedef struct lept_pool_chunk {
+    struct lept_pool_chunk* next;
+    size_t size, top;
+}lept_pool_chunk;
+
+struct lept_pool {
+    lept_allocator a;
+    lept_pool_chunk* head;  // allocating from this one
+    size_t chunk_size;
+    char* last;             // latest block, the only one free/realloc can give back or extend
+};
+
+#define LEPT_POOL_DATA(k) ((char*)((k) + 1))
+#define LEPT_POOL_SIZE(p) (((size_t*)(p))[-1])
+
+static void* lept_pool_alloc(void* ud, size_t size){
+    lept_pool* pool = (lept_pool*)ud;
+    lept_pool_chunk* k = pool->head;
+    size_t n = sizeof(size_t) + LEPT_POOL_ALIGN(size);
+    char* p;
+    if (k == NULL || k->size - k->top < n){
+        size_t csize = n > pool->chunk_size ? n : pool->chunk_size;
+        if ((k = (lept_pool_chunk*)malloc(sizeof(lept_pool_chunk) + csize)) == NULL)
+            return NULL;
+        k->size = csize;
+        k->top = 0;
+        k->next = pool->head;
+        pool->head = k;
+    }
+    p = LEPT_POOL_DATA(k) + k->top + sizeof(size_t);
+    LEPT_POOL_SIZE(p) = size;
+    k->top += n;
+    return pool->last = p;
+}
+
+static void* lept_pool_realloc(void* ud, void* p, size_t size){
+    lept_pool* pool = (lept_pool*)ud;
+    lept_pool_chunk* k = pool->head;
+    size_t old;
+    char* q;
+    if (p == NULL)
+        return lept_pool_alloc(ud, size);
+    old = LEPT_POOL_SIZE(p);
+    // the parse stack is usually the latest block, grow it in place
+    if (p == pool->last && k->size - k->top + LEPT_POOL_ALIGN(old) >= LEPT_POOL_ALIGN(size)){
+        k->top += LEPT_POOL_ALIGN(size) - LEPT_POOL_ALIGN(old);
+        LEPT_POOL_SIZE(p) = size;
+        return p;
+    }
+    if ((q = (char*)lept_pool_alloc(ud, size)) != NULL)
+        memcpy(q, p, old < size ? old : size);
+    return q;
+}
+
+static void lept_pool_free(void* ud, void* p){
+    lept_pool* pool = (lept_pool*)ud;
+    if (p != NULL && p == pool->last){
+        pool->head->top -= sizeof(size_t) + LEPT_POOL_ALIGN(LEPT_POOL_SIZE(p));
+        pool->last = NULL;
+    }
+}
+
+lept_pool* lept_pool_create(size_t chunk_size){
+    lept_pool* pool = (lept_pool*)malloc(sizeof(lept_pool));
+    pool->a.alloc = lept_pool_alloc;
+    pool->a.realloc = lept_pool_realloc;
+    pool->a.free = lept_pool_free;
+    pool->a.ud = pool;
+    pool->head = NULL;
+    pool->chunk_size = chunk_size ? chunk_size : LEPT_POOL_CHUNK_SIZE;
+    pool->last = NULL;
+    return pool;
+}
+
+const lept_allocator* lept_pool_allocator(lept_pool* pool){
+    assert(pool != NULL);
+    return &pool->a;
+}
+
+void lept_pool_reset(lept_pool* pool){
+    lept_pool_chunk* k, *next, *keep = NULL;
+    assert(pool != NULL);
+    for (k = pool->head; k; k = k->next)
+        if (keep == NULL || k->size > keep->size)
+            keep = k;
+    for (k = pool->head; k; k = next){
+        next = k->next;
+        if (k != keep)
+            free(k);
+    }
+    if ((pool->head = keep) != NULL){
+        keep->top = 0;
+        keep->next = NULL;
+    }
+    pool->last = NULL;
+}
+
+void lept_pool_destroy(lept_pool* pool){
+    if (pool){
+        lept_pool_reset(pool);
+        free(pool->head);
+        free(pool);
+    }
+}
+
+/*
+ *  slab: every block is preceded by its size class, blocks of a class are linked through their first
+ *  word while free. the shared pool is guarded by a spin lock, held only to move a batch.
+ */
+#ifndef LEPT_SLAB_BATCH
+#define LEPT_SLAB_BATCH 32      // blocks moved between a thread and the shared pool at once
+#endif
+#define LEPT_SLAB_CHUNK (64 * 1024)
+#define LEPT_SLAB_CLASSES 10
+#define LEPT_SLAB_LARGE ((size_t)-1)
+#define LEPT_SLAB_CLASS(p) (((size_t*)(p))[-1])
+#define LEPT_SLAB_NEXT(p) (*(void**)(p))
+
+static const size_t lept_slab_size[LEPT_SLAB_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+
+typedef struct {
+    void* head[LEPT_SLAB_CLASSES];
+    size_t count[LEPT_SLAB_CLASSES];
+}lept_slab_cache;
+
+static struct {
+    void* head[LEPT_SLAB_CLASSES];
+    char* carve;            // unused tail of the latest chunk
+    size_t left;
+    volatile long lock;
+}lept_slab_shared;
+
+static LEPT_THREAD_LOCAL lept_slab_cache lept_slab_tls;
+
+#if defined(__GNUC__)
+#define LEPT_SLAB_LOCK() do { while (__sync_lock_test_and_set(&lept_slab_shared.lock, 1)) ; } while(0)
+#define LEPT_SLAB_UNLOCK() __sync_lock_release(&lept_slab_shared.lock)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define LEPT_SLAB_LOCK() do { while (_InterlockedExchange(&lept_slab_shared.lock, 1)) ; } while(0)
+#define LEPT_SLAB_UNLOCK() _InterlockedExchange(&lept_slab_shared.lock, 0)
+#else
+#define LEPT_SLAB_LOCK() do {} while(0)     // single-threaded use only
+#define LEPT_SLAB_UNLOCK() do {} while(0)
+#endif
+
+static size_t lept_slab_class(size_t size){
+    size_t i;
+    for (i = 0; i < LEPT_SLAB_CLASSES; i++)
+        if (size <= lept_slab_size[i])
+            return i;
+    return LEPT_SLAB_LARGE;
+}
+
+/* a batch from the shared pool into this thread's list, carving new blocks when it runs dry */
+static void lept_slab_refill(size_t cls){
+    lept_slab_cache* tc = &lept_slab_tls;
+    size_t n, need = sizeof(size_t) + lept_slab_size[cls];
+    LEPT_SLAB_LOCK();
+    for (n = 0; n < LEPT_SLAB_BATCH; n++){
+        void* p = lept_slab_shared.head[cls];
+        if (p)
+            lept_slab_shared.head[cls] = LEPT_SLAB_NEXT(p);
+        else{
+            if (lept_slab_shared.left < need){
+                char* chunk = (char*)malloc(LEPT_SLAB_CHUNK);
+                if (chunk == NULL)
+                    break;
+                lept_slab_shared.carve = chunk;
+                lept_slab_shared.left = LEPT_SLAB_CHUNK;
+            }
+            p = lept_slab_shared.carve + sizeof(size_t);
+            LEPT_SLAB_CLASS(p) = cls;
+            lept_slab_shared.carve += need;
+            lept_slab_shared.left -= need;
+        }
+        LEPT_SLAB_NEXT(p) = tc->head[cls];
+        tc->head[cls] = p;
+    }
+    LEPT_SLAB_UNLOCK();
+    tc->count[cls] += n;
+}
+
+/* the first n blocks of this thread's list back to the shared pool */
+static void lept_slab_release(size_t cls, size_t n){
+    lept_slab_cache* tc = &lept_slab_tls;
+    void* first = tc->head[cls], *last = first;
+    size_t i;
+    if (n == 0)
+        return;
+    for (i = 1; i < n; i++)
+        last = LEPT_SLAB_NEXT(last);
+    tc->head[cls] = LEPT_SLAB_NEXT(last);
+    tc->count[cls] -= n;
+    LEPT_SLAB_LOCK();
+    LEPT_SLAB_NEXT(last) = lept_slab_shared.head[cls];
+    lept_slab_shared.head[cls] = first;
+    LEPT_SLAB_UNLOCK();
+}
+
+static void* lept_slab_alloc(void* ud, size_t size){
+    lept_slab_cache* tc = &lept_slab_tls;
+    size_t cls = lept_slab_class(size);
+    void* p;
+    (void)ud;
+    if (cls == LEPT_SLAB_LARGE){
+        size_t* h = (size_t*)malloc(sizeof(size_t) + size);
+        if (h == NULL)
+            return NULL;
+        *h = LEPT_SLAB_LARGE;
+        return h + 1;
+    }
+    if (tc->head[cls] == NULL){
+        lept_slab_refill(cls);
+        if (tc->head[cls] == NULL)
+            return NULL;
+    }
+    p = tc->head[cls];
+    tc->head[cls] = LEPT_SLAB_NEXT(p);
+    tc->count[cls]--;
+    return p;
+}
+
+static void lept_slab_free(void* ud, void* p){
+    lept_slab_cache* tc = &lept_slab_tls;
+    size_t cls;
+    (void)ud;
+    if (p == NULL)
+        return;
+    if ((cls = LEPT_SLAB_CLASS(p)) == LEPT_SLAB_LARGE){
+        free((size_t*)p - 1);
+        return;
+    }
+    LEPT_SLAB_NEXT(p) = tc->head[cls];
+    tc->head[cls] = p;
+    if (++tc->count[cls] >= 2 * LEPT_SLAB_BATCH)
+        lept_slab_release(cls, LEPT_SLAB_BATCH);
+}
+
+static void* lept_slab_realloc(void* ud, void* p, size_t size){
+    size_t cls, old;
+    void* q;
+    if (p == NULL)
+        return lept_slab_alloc(ud, size);
+    cls = LEPT_SLAB_CLASS(p);
+    if (cls != LEPT_SLAB_LARGE && size <= lept_slab_size[cls])
+        return p;
+    if (cls == LEPT_SLAB_LARGE && lept_slab_class(size) == LEPT_SLAB_LARGE){
+        size_t* h = (size_t*)realloc((size_t*)p - 1, sizeof(size_t) + size);
+        return h ? h + 1 : NULL;
+    }
+    // moving between classes, the old block's size is only known by its class
+    old = cls == LEPT_SLAB_LARGE ? size : lept_slab_size[cls];
+    if ((q = lept_slab_alloc(ud, size)) != NULL){
+        memcpy(q, p, old < size ? old : size);
+        lept_slab_free(ud, p);
+    }
+    return q;
+}
+
+static const lept_allocator lept_slab = { lept_slab_alloc, lept_slab_realloc, lept_slab_free, NULL };
+
+const lept_allocator* lept_slab_allocator(){
+    return &lept_slab;
+}
+
+void lept_slab_flush(){
+    size_t i;
+    for (i = 0; i < LEPT_SLAB_CLASSES; i++)
+        lept_slab_release(i, lept_slab_tls.count[i]);
+}
+
+static void lept_block_free(void* p){
+    if (p){
+        lept_header* h = LEPT_HEADER(p);
+        if (h->index)
+            h->a->free(h->a->ud, h->index);
+        h->a->free(h->a->ud, h);
+    }
+}
+
+static void* lept_block_realloc(void* p, size_t capacity, size_t elem_size){
+    lept_header* h = p ? LEPT_HEADER(p) : NULL;
+    if (capacity == 0){
+        lept_block_free(p);
+        return NULL;
+    }
+    if (p == NULL){
+        const lept_allocator* a = lept_current_allocator();
+        h = (lept_header*)a->alloc(a->ud, sizeof(lept_header) + capacity * elem_size);
+        h->index = NULL;
+        h->a = a;
+        h->hash_state = LEPT_HASH_NONE;
+    }else
+        h = (lept_header*)h->a->realloc(h->a->ud, h, sizeof(lept_header) + capacity * elem_size);
+    h->capacity = capacity;
+    return h + 1;
+}
+
+/*
+ *  make room for n more items, capacity grows by 1.5x (same as the parse stack)
+ *  so a sequence of appends costs amortized O(1)
+ */
+static void* lept_block_grow(void* p, size_t size, size_t n, size_t elem_size){
+    size_t capacity = p ? LEPT_HEADER(p)->capacity : 0;
+    size_t need = size + n;
+    assert(need <= LEPT_SIZE_MAX);
+    if (need <= capacity)
+        return p;
+    if (capacity < 4)
+        capacity = 4;
+    while (capacity < need)
+        capacity += capacity >> 1;
+    return lept_block_realloc(p, capacity, elem_size);
+}
+
+static size_t lept_block_capacity(const void* p){
+    return p ? LEPT_HEADER(p)->capacity : 0;
+}
 
 
 static void* lept_context_push(lept_context* c, size_t size){
@@ -39,10 +567,16 @@ static void* lept_context_push(lept_context* c, size_t size){
         while (c->top + size >= c->size)
             c->size += c->size >> 1;
             // c->size *= 1.5;
-        c->stack = (char*)realloc(c->stack, c->size);
+        if (c->stack)
+            LEPT_STAT_ADD(c, reallocs, 1);
+        else
+            LEPT_STAT_ADD(c, mallocs, 1);
+        LEPT_STAT_ADD(c, stack_growths, 1);
+        c->stack = (char*)c->a->realloc(c->a->ud, c->stack, c->size);
     }
     ret = c->stack + c->top;
     c->top += size;
+    LEPT_STAT_MAX(c, stack_high, c->top);
     return ret;
 }
 
@@ -51,6 +585,70 @@ static void* lept_context_pop(lept_context* c, size_t size){
     return c->stack + (c->top -= size);
 }
 
+/*
+ *  context cache (opt-in): each thread keeps a few warmed-up stacks, so lept_parse and lept_stringify
+ *  don't malloc and grow a fresh one per call. stacks above the limit aren't kept. they come from the
+ *  global allocator and are only reused while it's still the same one.
+ */
+#define LEPT_CONTEXT_CACHE_SLOTS 2
+
+static size_t lept_context_cache_limit = 0;
+static LEPT_THREAD_LOCAL struct {
+    char* stack[LEPT_CONTEXT_CACHE_SLOTS];
+    size_t size[LEPT_CONTEXT_CACHE_SLOTS];
+    const lept_allocator* a[LEPT_CONTEXT_CACHE_SLOTS];
+}lept_context_cache;
+
+void lept_set_context_cache(size_t max_bytes){
+#ifdef LEPT_HAVE_THREAD_LOCAL
+    lept_context_cache_limit = max_bytes;
+#else
+    (void)max_bytes;    // would be shared between threads
+#endif
+}
+
+/* a cached stack for c, 0 if caching is off and c should do as before */
+static int lept_context_acquire(lept_context* c){
+    int i;
+    if (lept_context_cache_limit == 0)
+        return 0;
+    c->a = lept_current_allocator();
+    c->stack = NULL;
+    c->size = c->top = 0;
+    for (i = 0; i < LEPT_CONTEXT_CACHE_SLOTS; i++)
+        if (lept_context_cache.stack[i] && lept_context_cache.a[i] == c->a){
+            c->stack = lept_context_cache.stack[i];
+            c->size = lept_context_cache.size[i];
+            lept_context_cache.stack[i] = NULL;
+            break;
+        }
+    return 1;
+}
+
+static void lept_context_release(lept_context* c){
+    int i;
+    if (c->stack && c->size <= lept_context_cache_limit)
+        for (i = 0; i < LEPT_CONTEXT_CACHE_SLOTS; i++)
+            if (!lept_context_cache.stack[i]){
+                lept_context_cache.stack[i] = c->stack;
+                lept_context_cache.size[i] = c->size;
+                lept_context_cache.a[i] = c->a;
+                return;
+            }
+    if (c->stack)
+        c->a->free(c->a->ud, c->stack);
+}
+
+void lept_thread_cleanup(){
+    int i;
+    for (i = 0; i < LEPT_CONTEXT_CACHE_SLOTS; i++)
+        if (lept_context_cache.stack[i]){
+            lept_context_cache.a[i]->free(lept_context_cache.a[i]->ud, lept_context_cache.stack[i]);
+            lept_context_cache.stack[i] = NULL;
+        }
+    lept_slab_flush();
+}
+
 
 static void lept_parse_whitespace(lept_context* c){
     const char* p = c->json;
@@ -74,8 +672,10 @@ static int lept_parse_literal(lept_context* c, lept_value* v, const char* expect
     return LEPT_PARSE_OK;
 }
 
+static int lept_validate_number(const char** pp, const char* end);
+
 static int lept_parse_number(lept_context* c, lept_value* v){
-    const char* p = c->json;
+    const char* p = c->json, *q;
     if (*p == '-') p++;
     if (*p == '0') p++;
     else{
@@ -97,9 +697,21 @@ static int lept_parse_number(lept_context* c, lept_value* v){
         for(; ISDIGIT(*p); p++);
     }
 
-    v->u.n = strtod(c->json, NULL);
-    if (errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL))
-        return LEPT_PARSE_NUMBER_TOO_BIG;
+    if (c->lazy_numbers && (size_t)(p - c->json) <= LEPT_SSO_CAPACITY){
+        // stored like a short string, lept_get_number() converts it
+        q = c->json;
+        if (lept_validate_number(&q, p) != LEPT_PARSE_OK)
+            return LEPT_PARSE_NUMBER_TOO_BIG;
+        memcpy(v->u.ss, c->json, p - c->json);
+        v->u.ss[p - c->json] = '\0';
+        v->u.ss[LEPT_SSO_CAPACITY] = (char)(LEPT_SSO_CAPACITY - (p - c->json));
+        v->flags = LEPT_FLAG_RAW_NUMBER;
+    }else{
+        v->u.n = strtod(c->json, NULL);
+        if (errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL))
+            return LEPT_PARSE_NUMBER_TOO_BIG;
+        v->flags = 0;
+    }
     v->type = LEPT_NUMBER;
     c->json = p;
     return LEPT_PARSE_OK;
@@ -140,6 +752,57 @@ static void lept_encode_utf8(lept_context* c, unsigned int u){
     }
 }
 
+/*
+ *  RFC 3629 well-formed UTF-8 (no overlongs, surrogates or code points above U+10FFFF).
+ *  ASCII, the common case, is skipped eight bytes at a time.
+ */
+static int lept_utf8_valid(const char* str, size_t len){
+    const unsigned char* s = (const unsigned char*)str;
+    const unsigned char* end = s + len;
+    unsigned long long w;
+    unsigned char ch, lo, hi;
+    size_t n, i;
+    while (s < end){
+        if (*s < 0x80){
+            for (; end - s >= 8; s += 8){
+                memcpy(&w, s, 8);
+                if (w & 0x8080808080808080ULL)
+                    break;
+            }
+            while (s < end && *s < 0x80)
+                s++;
+            continue;
+        }
+        // the lead byte gives the length and the range of the second byte
+        ch = *s;
+        lo = 0x80;
+        hi = 0xBF;
+        if (ch >= 0xC2 && ch <= 0xDF)
+            n = 2;
+        else if (ch >= 0xE0 && ch <= 0xEF){
+            n = 3;
+            if (ch == 0xE0)
+                lo = 0xA0;      // overlong
+            else if (ch == 0xED)
+                hi = 0x9F;      // surrogates
+        }else if (ch >= 0xF0 && ch <= 0xF4){
+            n = 4;
+            if (ch == 0xF0)
+                lo = 0x90;      // overlong
+            else if (ch == 0xF4)
+                hi = 0x8F;      // above U+10FFFF
+        }else
+            return 0;
+        if ((size_t)(end - s) < n || s[1] < lo || s[1] > hi)
+            return 0;
+        for (i = 2; i < n; i++)
+            if ((s[i] & 0xC0) != 0x80)
+                return 0;
+        s += n;
+    }
+    return 1;
+}
+
 static int lept_parse_string_raw(lept_context* c, char** str, size_t* len){
     size_t head = c->top;
     unsigned int u, u2;
@@ -150,11 +813,16 @@ static int lept_parse_string_raw(lept_context* c, char** str, size_t* len){
         char ch = *p++;
         switch (ch){
             case '\"':
+                // escapes are ASCII, so the source span can be checked as it is
+                if (c->strict_utf8 && !lept_utf8_valid(c->json, p - 1 - c->json))
+                    STRING_ERROR(LEPT_PARSE_INVALID_UTF8);
                 *len = c->top - head;
                 *str = lept_context_pop(c, *len);
                 c->json = p;
+                LEPT_STAT_ADD(c, string_bytes, *len);
                 return LEPT_PARSE_OK;
             case '\\':
+                LEPT_STAT_ADD(c, escapes, 1);
                 switch (*p++) {
                     case '\"': PUTC(c, '\"'); break;
                     case '\\': PUTC(c, '\\'); break;
@@ -198,8 +866,10 @@ static int lept_parse_string(lept_context* c, lept_value* v){
     int ret;
     char* s;
     size_t len;
-    if ((ret = lept_parse_string_raw(c, &s, &len)) == LEPT_PARSE_OK)
+    if ((ret = lept_parse_string_raw(c, &s, &len)) == LEPT_PARSE_OK){
         lept_set_string(v, s, len);
+        LEPT_STAT_ADD(c, mallocs, len > LEPT_SSO_CAPACITY);
+    }
     return ret;
 }
 
@@ -228,11 +898,13 @@ static int lept_parse_array(lept_context* c, lept_value* v){
             lept_parse_whitespace(c);
         }else if (*(c->json) == ']'){
             c->json++;
+            assert(size <= LEPT_SIZE_MAX);
             v->type = LEPT_ARRAY;
             v->u.a.size = size;
             size *= sizeof(lept_value);
-            v->u.a.e = (lept_value*)malloc(size);
+            v->u.a.e = (lept_value*)lept_block_realloc(NULL, v->u.a.size, sizeof(lept_value));
             memcpy(v->u.a.e, lept_context_pop(c, size), size);
+            LEPT_STAT_ADD(c, mallocs, 1);
             return LEPT_PARSE_OK;
         }else{
             ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
@@ -339,8 +1011,9 @@ static int lept_parse_object(lept_context* c, lept_value* v){
         }
         if ((ret = lept_parse_string_raw(c, &str, &m.klen)) != LEPT_PARSE_OK)
             break;
-        memcpy(m.k = (char*)malloc(m.klen + 1), str, m.klen);
+        memcpy(m.k = (char*)lept_mem_alloc(m.klen + 1), str, m.klen);
         m.k[m.klen] = '\0';
+        LEPT_STAT_ADD(c, mallocs, 1);
         // parse ws colon ws
         lept_parse_whitespace(c);
         if (*c->json != ':'){
@@ -362,11 +1035,13 @@ static int lept_parse_object(lept_context* c, lept_value* v){
             lept_parse_whitespace(c);
         }else if (*c->json == '}'){
             c->json++;
+            assert(size <= LEPT_SIZE_MAX);
             v->type = LEPT_OBJECT;
             v->u.o.size = size;
             size *= sizeof(lept_member);
-            v->u.o.m = (lept_member*)malloc(size);
+            v->u.o.m = (lept_member*)lept_block_realloc(NULL, v->u.o.size, sizeof(lept_member));
             memcpy(v->u.o.m, lept_context_pop(c, size), size);
+            LEPT_STAT_ADD(c, mallocs, 1);
             // lept_parse_whitespace(c);
             // size_t s = sizeof(lept_member) * size;
             // c->json++;
@@ -380,11 +1055,11 @@ static int lept_parse_object(lept_context* c, lept_value* v){
         }
     }
     // Pop and free members on the stack
-    free(m.k);
+    lept_mem_free(m.k);
     size_t i;
     for (i = 0; i < size; i++){
         lept_member* m = (lept_member*)lept_context_pop(c, sizeof(lept_member));
-        free(m->k);
+        lept_mem_free(m->k);
         lept_free(&m->v);
     }
     v->type = LEPT_NULL;
@@ -394,328 +1069,3426 @@ static int lept_parse_object(lept_context* c, lept_value* v){
 
 
 static int lept_parse_value(lept_context* c, lept_value* v){
+    int ret;
+    LEPT_STAT_ENTER(c);
     switch (*c->json){
-        case 'n': return lept_parse_literal(c, v, "null", LEPT_NULL);
-        case 't': return lept_parse_literal(c, v, "true", LEPT_TRUE);
-        case 'f': return lept_parse_literal(c, v, "false", LEPT_FALSE);
-        case '\"': return lept_parse_string(c, v);
-        case '[': return lept_parse_array(c, v);
-        case '{': return lept_parse_object(c, v);
-        default: return lept_parse_number(c, v);
-        case '\0': return LEPT_PARSE_EXPECT_VALUE;
+        case 'n': ret = lept_parse_literal(c, v, "null", LEPT_NULL); break;
+        case 't': ret = lept_parse_literal(c, v, "true", LEPT_TRUE); break;
+        case 'f': ret = lept_parse_literal(c, v, "false", LEPT_FALSE); break;
+        case '\"': ret = lept_parse_string(c, v); break;
+        case '[': ret = lept_parse_array(c, v); break;
+        case '{': ret = lept_parse_object(c, v); break;
+        default: ret = lept_parse_number(c, v); break;
+        case '\0': ret = LEPT_PARSE_EXPECT_VALUE; break;
     }
+    LEPT_STAT_LEAVE(c, v, ret);
+    return ret;
 }
 
-int lept_parse(lept_value* v, const char* json){
-    lept_context c;
-    int t;
-    assert(v != NULL);
-    c.json = json;
-    c.stack = NULL;
-    c.size = 0;
-    c.top = 0;
-    lept_init(v);
-    lept_parse_whitespace(&c);
-    t = lept_parse_value(&c, v);
-    if (t == LEPT_PARSE_OK){
-        lept_parse_whitespace(&c);
-        if (*(c.json) != '\0'){
-            t = LEPT_PARSE_ROOT_NOT_SINGULAR;
-            v->type = LEPT_NULL;
+/*
+ *  projection: a trie of paths (JSON Pointer syntax, "*" matches any member/element),
+ *  only values on these paths are materialized, everything else is skipped
+ */
+typedef struct lept_field lept_field;
+struct lept_field {
+    lept_token t;
+    int any;            // token "*"
+    int all;            // a path ends here: keep the whole subtree
+    size_t n;
+    lept_field* child;
+};
+
+struct lept_fieldset {
+    lept_field root;
+};
+
+static lept_field* lept_field_child(lept_field* f, const lept_token* t){
+    size_t i;
+    lept_field* ch;
+    for (i = 0; i < f->n; i++)
+        if (f->child[i].t.klen == t->klen && memcmp(f->child[i].t.key, t->key, t->klen) == 0)
+            return &f->child[i];
+    f->child = (lept_field*)realloc(f->child, (f->n + 1) * sizeof(lept_field));
+    ch = &f->child[f->n++];
+    memset(ch, 0, sizeof(lept_field));
+    ch->t = *t;
+    ch->t.key = (char*)malloc(t->klen + 1);
+    memcpy((char*)ch->t.key, t->key, t->klen + 1);
+    ch->any = t->klen == 1 && t->key[0] == '*';
+    return ch;
+}
+
+lept_fieldset* lept_fieldset_compile(const char* const* pointers, size_t n){
+    lept_fieldset* fs;
+    size_t i, j;
+    assert(pointers != NULL || n == 0);
+    fs = (lept_fieldset*)calloc(1, sizeof(lept_fieldset));
+    for (i = 0; i < n; i++){
+        lept_pointer* p = lept_pointer_compile(pointers[i]);
+        lept_field* f = &fs->root;
+        if (p == NULL){
+            lept_fieldset_free(fs);
+            return NULL;
         }
+        for (j = 0; j < p->n; j++)
+            f = lept_field_child(f, &p->t[j]);
+        f->all = 1;
+        lept_pointer_free(p);
     }
-    assert(c.top == 0);     // make sure, stack is empty.
-    free(c.stack);
-    return t;
+    return fs;
 }
 
-lept_type lept_get_type(const lept_value* v){
-    assert(v != NULL);
-    return v->type;
-}
-int lept_is_equal(const lept_value* lhs, const lept_value* rhs){
-    assert(lhs != NULL);
-    assert(rhs != NULL);
+static void lept_field_free(lept_field* f){
     size_t i;
-    if (lhs->type != rhs->type)
-        return 0;
-    switch (lhs->type){
-        case LEPT_STRING:
-            return lhs->u.s.len == rhs->u.s.len &&
-                memcmp(lhs->u.s.s, rhs->u.s.s, lhs->u.s.len) == 0;
-        case LEPT_NUMBER:
-            return lhs->u.n == rhs->u.n;
-        case LEPT_ARRAY:
-            if (lhs->u.a.size != rhs->u.a.size)
-                return 0;
-            for (i = 0; i < lhs->u.a.size; i++)
-                if (!lept_is_equal(&lhs->u.a.e[i], &rhs->u.a.e[i]))
-                    return 0;
-        case LEPT_OBJECT:
-            // todo ....
-            if (lhs->u.o.size != rhs->u.o.size)
-                return 0;
-            for (i = 0; i < lhs->u.o.size; i++){
-                size_t index = lept_find_object_index(rhs, lhs->u.o.m[i].k, lhs->u.o.m[i].klen);
-                if (index == LEPT_KEY_NOT_EXIST)
-                    return 0;
-                if (!lept_is_equal(&lhs->u.o.m[i].v, &rhs->u.o.m[index].v))
-                    return 0;
-            }
-            return 1;
-        default:
-            return 1;
+    for (i = 0; i < f->n; i++){
+        lept_field_free(&f->child[i]);
+        free((char*)f->child[i].t.key);
     }
+    free(f->child);
 }
 
-double lept_get_number(const lept_value* v){
-    assert(v != NULL);
-    assert(v->type == LEPT_NUMBER);
-    return v->u.n;
+void lept_fieldset_free(lept_fieldset* fs){
+    if (fs != NULL){
+        lept_field_free(&fs->root);
+        free(fs);
+    }
 }
-void lept_set_number(lept_value* v, double n){
-    assert(v != NULL);
-    lept_free(v);
-    v->type = LEPT_NUMBER;
-    v->u.n = n;
+
+/*
+ *  validate-only: the grammar of lept_parse_value over a length-delimited buffer, without a
+ *  context. lept_validate and lept_skip_value use it. containers are tracked in a bit per
+ *  level, so the depth has to be bounded.
+ */
+#define LEPT_SWAR_ONES 0x0101010101010101ULL
+#define LEPT_SWAR_HIGH 0x8080808080808080ULL
+
+/* some byte of w is '"', '\\' or a control character */
+static int lept_swar_string_special(unsigned long long w){
+    unsigned long long q = w ^ (LEPT_SWAR_ONES * '\"'), b = w ^ (LEPT_SWAR_ONES * '\\');
+    return (((q - LEPT_SWAR_ONES) & ~q) | ((b - LEPT_SWAR_ONES) & ~b) | ((w - LEPT_SWAR_ONES * 0x20) & ~w)) & LEPT_SWAR_HIGH ? 1 : 0;
 }
 
-void lept_free(lept_value* v){
-    size_t i;
-    assert(v != NULL);
-    if (v->type == LEPT_STRING){
-        free(v->u.s.s);
-    }else if (v->type == LEPT_ARRAY){
-        for (i = 0; i < v->u.a.size; i++)
-            lept_free(&v->u.a.e[i]);
-        free(v->u.a.e);
-    }else if(v->type == LEPT_OBJECT){
-        for (i = 0; i < v->u.o.size; i++){
-            lept_free(&v->u.o.m[i].v);
-            free(v->u.o.m[i].k);
-        }
-        free(v->u.o.m);
-    }
-    v->type = LEPT_NULL;
+static const char* lept_validate_whitespace(const char* p, const char* end){
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
+}
+
+static int lept_validate_literal(const char** pp, const char* end, const char* literal){
+    const char* p = *pp;
+    for (; *literal; literal++, p++)
+        if (p == end || *p != *literal){
+            *pp = p;
+            return LEPT_PARSE_INVALID_VALUE;
+        }
+    *pp = p;
+    return LEPT_PARSE_OK;
+}
+
+/* exactly 2^1024 - 2^970: strtod() rounds this and everything above it to HUGE_VAL */
+static const char lept_overflow_digits[] =
+    "17976931348623158079372897140530341507993413271003782693617377898044496829276475094664901797758720709633"
+    "02864166928879109465555478519404026306574886715058206819089020007083836762738548458177115317644757302700"
+    "69855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497792";
+
+/* significant digits of [p, end) compared with lept_overflow_digits, '.' is skipped */
+static int lept_validate_overflows(const char* p, const char* end){
+    const char* d = lept_overflow_digits;
+    for (; p < end && (ISDIGIT(*p) || *p == '.'); p++){
+        if (*p == '.')
+            continue;
+        if (*d == '\0')
+            return 1;
+        if (*p != *d)
+            return *p > *d;
+        d++;
+    }
+    return *d == '\0';
+}
+
+/*
+ *  the number is never converted: its decimal exponent (value = 0.ddd * 10^e) is counted and
+ *  only a number with the exponent of DBL_MAX is compared digit by digit.
+ */
+static int lept_validate_number(const char** pp, const char* end){
+    const size_t limit = (size_t)-1 / 4;
+    const char* p = *pp, *lead = NULL;
+    size_t up = 0, down = 0, exp = 0;
+    int negative_exp = 0;
+    if (p < end && *p == '-') p++;
+    if (p < end && *p == '0') p++;
+    else{
+        if (p == end || !IS1TO9(*p)){ *pp = p; return LEPT_PARSE_INVALID_VALUE; }
+        for (lead = p; p < end && ISDIGIT(*p); p++)
+            up++;
+    }
+    if (p < end && *p == '.'){
+        p++;
+        if (p == end || !ISDIGIT(*p)){ *pp = p; return LEPT_PARSE_INVALID_VALUE; }
+        for (; p < end && ISDIGIT(*p); p++)
+            if (!lead){
+                if (*p == '0')
+                    down++;
+                else
+                    lead = p;
+            }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')){
+        p++;
+        if (p < end && (*p == '+' || *p == '-'))
+            negative_exp = *p++ == '-';
+        if (p == end || !ISDIGIT(*p)){ *pp = p; return LEPT_PARSE_INVALID_VALUE; }
+        // saturates at limit, far past any exponent that still fits a double
+        for (; p < end && ISDIGIT(*p); p++)
+            exp = exp <= (limit - 9) / 10 ? exp * 10 + (*p - '0') : limit;
+    }
+    if (negative_exp)
+        down += exp;
+    else
+        up += exp;
+    if (lead && (up > down + DBL_MAX_10_EXP + 1 ||
+        (up == down + DBL_MAX_10_EXP + 1 && lept_validate_overflows(lead, end))))
+        return LEPT_PARSE_NUMBER_TOO_BIG;
+    *pp = p;
+    return LEPT_PARSE_OK;
+}
+
+static const char* lept_validate_hex4(const char* p, const char* end, unsigned int* u){
+    return end - p >= 4 ? lept_parse_hex4(p, u) : NULL;
+}
+
+/* ASCII without '"', '\\' or control characters is skipped eight bytes at a time */
+static int lept_validate_string(const char** pp, const char* end, int strict_utf8){
+    const char* p = *pp + 1;
+    unsigned long long w;
+    unsigned int u;
+    int ret = LEPT_PARSE_OK;
+    for (;;){
+        for (; end - p >= 8; p += 8){
+            memcpy(&w, p, 8);
+            if (lept_swar_string_special(w))
+                break;
+        }
+        while (p < end && *p != '\"' && *p != '\\' && (unsigned char)*p >= 0x20)
+            p++;
+        if (p == end){
+            ret = LEPT_PARSE_MISS_QUOTATION_MARK;
+            break;
+        }
+        if (*p == '\"'){
+            // escapes are ASCII, so the source span can be checked as it is
+            if (strict_utf8 && !lept_utf8_valid(*pp + 1, p - *pp - 1)){
+                ret = LEPT_PARSE_INVALID_UTF8;
+                break;
+            }
+            p++;
+            break;
+        }
+        if (*p == '\\'){
+            if (++p == end){
+                ret = LEPT_PARSE_INVALID_STRING_ESCAPE;
+                break;
+            }
+            if (*p == 'u'){
+                const char* q = lept_validate_hex4(p + 1, end, &u);
+                if (!q){
+                    ret = LEPT_PARSE_INVALID_UNICODE_HEX;
+                    break;
+                }
+                if (u >= 0xd800 && u <= 0xdbff){
+                    if (end - q < 2 || q[0] != '\\' || q[1] != 'u' ||
+                        !lept_validate_hex4(q + 2, end, &u) || u < 0xdc00 || u > 0xdfff){
+                        ret = LEPT_PARSE_INVALID_UNICODE_SURROGATE;
+                        break;
+                    }
+                    q += 6;
+                }
+                p = q;
+                continue;
+            }
+            if (!strchr("\"\\/bfnrt", *p) || *p == '\0'){
+                ret = LEPT_PARSE_INVALID_STRING_ESCAPE;
+                break;
+            }
+        }else{
+            ret = LEPT_PARSE_INVALID_STRING_CHAR;
+            break;
+        }
+        p++;
+    }
+    *pp = p;
+    return ret;
+}
+
+static int lept_validate_scalar(const char** pp, const char* end, int strict_utf8){
+    if (*pp == end)
+        return LEPT_PARSE_EXPECT_VALUE;
+    switch (**pp){
+        case 'n':  return lept_validate_literal(pp, end, "null");
+        case 't':  return lept_validate_literal(pp, end, "true");
+        case 'f':  return lept_validate_literal(pp, end, "false");
+        case '\"': return lept_validate_string(pp, end, strict_utf8);
+        case '\0': return LEPT_PARSE_EXPECT_VALUE;
+        default:   return lept_validate_number(pp, end);
+    }
+}
+
+/* "key" : and the whitespace after it */
+static int lept_validate_key(const char** pp, const char* end, int strict_utf8){
+    int ret;
+    if (*pp == end || **pp != '\"')
+        return LEPT_PARSE_MISS_KEY;
+    if ((ret = lept_validate_string(pp, end, strict_utf8)) != LEPT_PARSE_OK)
+        return ret;
+    *pp = lept_validate_whitespace(*pp, end);
+    if (*pp == end || **pp != ':')
+        return LEPT_PARSE_MISS_COLON;
+    *pp = lept_validate_whitespace(*pp + 1, end);
+    return LEPT_PARSE_OK;
+}
+
+/* one value at *pp, no whitespace around it. *pp ends up after it, or where an error was found */
+static int lept_validate_value(const char** pp, const char* end, int strict_utf8){
+    unsigned char object[LEPT_VALIDATE_MAX_DEPTH / 8 + 1];    // bit per open container: 1 object, 0 array
+    const char* p = *pp;
+    size_t depth = 0;
+    int ret = LEPT_PARSE_OK, is_object;
+    while (ret == LEPT_PARSE_OK){
+        // a value starts at p
+        if (p < end && (*p == '[' || *p == '{')){
+            if (depth == LEPT_VALIDATE_MAX_DEPTH){
+                ret = LEPT_PARSE_NESTING_TOO_DEEP;
+                break;
+            }
+            is_object = *p == '{';
+            if (is_object)
+                object[depth / 8] |= (unsigned char)(1u << depth % 8);
+            else
+                object[depth / 8] &= (unsigned char)~(1u << depth % 8);
+            depth++;
+            p = lept_validate_whitespace(p + 1, end);
+            if (p < end && *p == (is_object ? '}' : ']')){
+                p++;
+                depth--;
+            }else{
+                if (is_object)
+                    ret = lept_validate_key(&p, end, strict_utf8);
+                continue;
+            }
+        }else if ((ret = lept_validate_scalar(&p, end, strict_utf8)) != LEPT_PARSE_OK)
+            break;
+        // after a value: close containers until a ',' or the end of the outermost one
+        for (;;){
+            if (depth == 0){
+                *pp = p;
+                return LEPT_PARSE_OK;
+            }
+            p = lept_validate_whitespace(p, end);
+            is_object = (object[(depth - 1) / 8] >> (depth - 1) % 8) & 1;
+            if (p < end && *p == ','){
+                p = lept_validate_whitespace(p + 1, end);
+                if (is_object)
+                    ret = lept_validate_key(&p, end, strict_utf8);
+                break;
+            }
+            if (p == end || *p != (is_object ? '}' : ']')){
+                ret = is_object ? LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET : LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                break;
+            }
+            p++;
+            depth--;
+        }
+    }
+    *pp = p;
+    return ret;
+}
+
+int lept_validate(const char* json, size_t len, size_t* err_offset){
+    const char* p, *end = json + len;
+    int ret;
+    assert(json != NULL || len == 0);
+    p = lept_validate_whitespace(json, end);
+    if ((ret = lept_validate_value(&p, end, 0)) == LEPT_PARSE_OK){
+        p = lept_validate_whitespace(p, end);
+        if (p != end)
+            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    if (err_offset && ret != LEPT_PARSE_OK)
+        *err_offset = (size_t)(p - json);
+    return ret;
+}
+
+/*
+ *  skip one value without materializing it. it goes through the lept_validate scanner, so
+ *  skipped parts are held to the same grammar as parsed ones.
+ */
+static int lept_skip_value(lept_context* c){
+    if (c->end == NULL)
+        c->end = c->json + strlen(c->json);
+    return lept_validate_value(&c->json, c->end, c->strict_utf8);
+}
+
+static int lept_parse_projected(lept_context* c, lept_value* v, const lept_field* f, int* kept);
+
+static const lept_field* lept_field_match(const lept_field* f, const char* key, size_t klen, size_t index){
+    size_t i;
+    for (i = 0; i < f->n; i++){
+        const lept_field* ch = &f->child[i];
+        if (ch->any || (key ? ch->t.klen == klen && memcmp(ch->t.key, key, klen) == 0 : ch->t.index == index))
+            return ch;
+    }
+    return NULL;
+}
+
+static int lept_parse_object_projected(lept_context* c, lept_value* v, const lept_field* f){
+    size_t i, size = 0;
+    lept_member m;
+    int ret, kept;
+    EXPECT(c, '{');
+    lept_parse_whitespace(c);
+    if (*c->json == '}'){
+        c->json++;
+        lept_set_object(v, 0);
+        return LEPT_PARSE_OK;
+    }
+    for (;;){
+        const lept_field* ch;
+        char* str;
+        if (*c->json != '\"'){
+            ret = LEPT_PARSE_MISS_KEY;
+            break;
+        }
+        if ((ret = lept_parse_string_raw(c, &str, &m.klen)) != LEPT_PARSE_OK)
+            break;
+        // str still points into the stack, match before anything else is pushed
+        ch = lept_field_match(f, str, m.klen, 0);
+        m.k = NULL;
+        if (ch){
+            memcpy(m.k = (char*)lept_mem_alloc(m.klen + 1), str, m.klen);
+            m.k[m.klen] = '\0';
+        }
+        lept_parse_whitespace(c);
+        if (*c->json != ':'){
+            lept_mem_free(m.k);
+            ret = LEPT_PARSE_MISS_COLON;
+            break;
+        }
+        c->json++;
+        lept_parse_whitespace(c);
+        lept_init(&m.v);
+        kept = 0;
+        ret = ch ? lept_parse_projected(c, &m.v, ch, &kept) : lept_skip_value(c);
+        if (ret != LEPT_PARSE_OK){
+            lept_mem_free(m.k);
+            break;
+        }
+        if (kept){
+            memcpy(lept_context_push(c, sizeof(lept_member)), &m, sizeof(lept_member));
+            size++;
+        }else
+            lept_mem_free(m.k);
+        lept_parse_whitespace(c);
+        if (*c->json == ','){
+            c->json++;
+            lept_parse_whitespace(c);
+        }else if (*c->json == '}'){
+            c->json++;
+            lept_set_object(v, size);
+            if ((v->u.o.size = size) > 0)
+                memcpy(v->u.o.m, lept_context_pop(c, size * sizeof(lept_member)), size * sizeof(lept_member));
+            return LEPT_PARSE_OK;
+        }else{
+            ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        }
+    }
+    for (i = 0; i < size; i++){
+        lept_member* pm = (lept_member*)lept_context_pop(c, sizeof(lept_member));
+        lept_mem_free(pm->k);
+        lept_free(&pm->v);
+    }
+    return ret;
+}
+
+/* unselected elements become null (so indices still line up), nothing is kept past the last selected index */
+static int lept_parse_array_projected(lept_context* c, lept_value* v, const lept_field* f){
+    size_t i, size = 0, index = 0, last = 0;
+    int ret, kept, any = 0;
+    for (i = 0; i < f->n; i++){
+        if (f->child[i].any)
+            any = 1;
+        else if (f->child[i].t.index != LEPT_KEY_NOT_EXIST && f->child[i].t.index + 1 > last)
+            last = f->child[i].t.index + 1;
+    }
+    EXPECT(c, '[');
+    lept_parse_whitespace(c);
+    if (*c->json == ']'){
+        c->json++;
+        lept_set_array(v, 0);
+        return LEPT_PARSE_OK;
+    }
+    for (;; index++){
+        const lept_field* ch = lept_field_match(f, NULL, 0, index);
+        lept_value e;
+        lept_init(&e);
+        kept = 0;
+        ret = ch ? lept_parse_projected(c, &e, ch, &kept) : lept_skip_value(c);
+        if (ret != LEPT_PARSE_OK)
+            break;
+        if (any || index < last){
+            memcpy(lept_context_push(c, sizeof(lept_value)), &e, sizeof(lept_value));
+            size++;
+        }
+        lept_parse_whitespace(c);
+        if (*c->json == ','){
+            c->json++;
+            lept_parse_whitespace(c);
+        }else if (*c->json == ']'){
+            c->json++;
+            lept_set_array(v, size);
+            if ((v->u.a.size = size) > 0)
+                memcpy(v->u.a.e, lept_context_pop(c, size * sizeof(lept_value)), size * sizeof(lept_value));
+            return LEPT_PARSE_OK;
+        }else{
+            ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        }
+    }
+    for (i = 0; i < size; i++)
+        lept_free((lept_value*)lept_context_pop(c, sizeof(lept_value)));
+    return ret;
+}
+
+/* *kept is 0 when nothing under f can match (a scalar where a container is expected) */
+static int lept_parse_projected(lept_context* c, lept_value* v, const lept_field* f, int* kept){
+    *kept = 1;
+    if (f->all)
+        return lept_parse_value(c, v);
+    switch (*c->json){
+        case '{': return lept_parse_object_projected(c, v, f);
+        case '[': return lept_parse_array_projected(c, v, f);
+        default:
+            *kept = 0;
+            return lept_skip_value(c);
+    }
+}
+
+int lept_parse_ex(lept_value* v, const char* json, const lept_parse_options* opt){
+    lept_context c;
+    int t, kept, cached = 0;
+    const lept_allocator* saved = lept_scoped_allocator;
+    LEPT_STAT_TIME(start);
+    assert(v != NULL);
+    if (opt != NULL && opt->allocator != NULL)
+        lept_scoped_allocator = opt->allocator;
+    else
+        cached = lept_context_acquire(&c);
+    if (!cached){
+        c.stack = NULL;
+        c.size = 0;
+        c.top = 0;
+        c.a = lept_current_allocator();
+    }
+    c.json = json;
+    c.strict_utf8 = opt != NULL && opt->strict_utf8;
+    c.lazy_numbers = opt != NULL && opt->lazy_numbers;
+    c.end = NULL;
+    LEPT_CONTEXT_STATS(&c, opt != NULL ? opt->stats : NULL);
+    lept_init(v);
+    lept_parse_whitespace(&c);
+    if (opt != NULL && opt->fields != NULL)
+        t = lept_parse_projected(&c, v, &opt->fields->root, &kept);
+    else
+        t = lept_parse_value(&c, v);
+    if (t == LEPT_PARSE_OK){
+        lept_parse_whitespace(&c);
+        if (*(c.json) != '\0'){
+            t = LEPT_PARSE_ROOT_NOT_SINGULAR;
+            lept_free(v);
+        }
+    }
+    assert(c.top == 0);     // make sure, stack is empty.
+    if (cached)
+        lept_context_release(&c);
+    else if (c.stack)
+        c.a->free(c.a->ud, c.stack);
+    lept_scoped_allocator = saved;
+    LEPT_STAT_ADD(&c, input_bytes, c.json - json);
+    LEPT_STAT_ELAPSED(&c, parse_time, start);
+    return t;
+}
+
+int lept_parse(lept_value* v, const char* json){
+    return lept_parse_ex(v, json, NULL);
+}
+
+/* whole stream into a NUL-terminated heap buffer, for pipes and where mmap isn't available */
+static int lept_parse_stream(lept_value* v, FILE* fp){
+    size_t size = 0, capacity = LEPT_PARSE_STACK_INIT_SIZE, n;
+    char* json = (char*)malloc(capacity);
+    int ret;
+    while ((n = fread(json + size, 1, capacity - size - 1, fp)) > 0){
+        size += n;
+        if (capacity - size == 1)
+            json = (char*)realloc(json, capacity += capacity >> 1);
+    }
+    if (ferror(fp))
+        ret = LEPT_PARSE_FILE_ERROR;
+    else{
+        json[size] = '\0';
+        ret = lept_parse(v, json);
+    }
+    free(json);
+    return ret;
+}
+
+/*
+ *  regular files are parsed straight from a private mapping. the mapping has no NUL after the last
+ *  byte when the file size is a multiple of the page size, so an anonymous (zeroed) region one page
+ *  longer is reserved first and the file is mapped over its start with MAP_FIXED.
+ *  the overlay is safe: MAP_FIXED only replaces pages of the region reserved here, never someone
+ *  else's mapping. the file covers [0, size) and the reservation is rounded up past size, so when
+ *  size is an exact multiple of the page size the page at base + size is still the anonymous one
+ *  and reads as zero. otherwise the file's last page is partial and the kernel zero-fills it past
+ *  the end of the file. either way base[size] is the terminating NUL.
+ */
+int lept_parse_file(lept_value* v, const char* path){
+    FILE* fp;
+    int ret;
+    assert(v != NULL && path != NULL);
+    lept_init(v);
+#ifdef LEPT_HAVE_MMAP
+    {
+        struct stat st;
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return LEPT_PARSE_FILE_ERROR;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            size_t size = (size_t)st.st_size;
+            size_t length = (size / page + 1) * page;
+            char* base = (char*)mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base != MAP_FAILED){
+                if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED){
+                    close(fd);
+#ifdef MADV_SEQUENTIAL
+                    madvise(base, length, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+                    madvise(base, length, MADV_HUGEPAGE);
+#endif
+                    ret = lept_parse(v, base);
+                    munmap(base, length);
+                    return ret;
+                }
+                munmap(base, length);
+            }
+        }
+        if ((fp = fdopen(fd, "rb")) == NULL){
+            close(fd);
+            return LEPT_PARSE_FILE_ERROR;
+        }
+    }
+#else
+    if ((fp = fopen(path, "rb")) == NULL)
+        return LEPT_PARSE_FILE_ERROR;
+#endif
+    ret = lept_parse_stream(v, fp);
+    fclose(fp);
+    return ret;
+}
+
+/*
+ *  descriptor-driven parsing, keys are matched by precomputed length and hash
+ */
+struct lept_schema {
+    size_t n;
+    const lept_field_desc* d;
+    size_t* klen;
+    size_t* hash;
+    lept_schema** nested;
+    char** lit;         // pre-escaped "key": for lept_stringify_struct()
+    size_t* litlen;
+};
+
+lept_schema* lept_schema_compile(const lept_field_desc* fields){
+    lept_schema* s;
+    size_t i, n = 0;
+    assert(fields != NULL);
+    while (fields[n].key != NULL)
+        n++;
+    s = (lept_schema*)malloc(sizeof(lept_schema));
+    s->n = n;
+    s->d = fields;
+    s->klen = (size_t*)malloc((n ? n : 1) * sizeof(size_t));
+    s->hash = (size_t*)malloc((n ? n : 1) * sizeof(size_t));
+    s->nested = (lept_schema**)calloc(n ? n : 1, sizeof(lept_schema*));
+    s->lit = (char**)malloc((n ? n : 1) * sizeof(char*));
+    s->litlen = (size_t*)malloc((n ? n : 1) * sizeof(size_t));
+    for (i = 0; i < n; i++){
+        lept_context c;
+        s->klen[i] = strlen(fields[i].key);
+        s->hash[i] = lept_hash_key(fields[i].key, s->klen[i]);
+        c.stack = NULL;
+        c.size = c.top = 0;
+        c.a = &lept_std_allocator;
+        LEPT_CONTEXT_STATS(&c, NULL);
+        lept_stringify_string(&c, fields[i].key, s->klen[i]);
+        PUTC(&c, ':');
+        s->lit[i] = c.stack;
+        s->litlen[i] = c.top;
+        if (fields[i].type == LEPT_FIELD_STRUCT)
+            s->nested[i] = lept_schema_compile(fields[i].nested);
+    }
+    return s;
+}
+
+void lept_schema_free(lept_schema* s){
+    size_t i;
+    if (s == NULL)
+        return;
+    for (i = 0; i < s->n; i++){
+        lept_schema_free(s->nested[i]);
+        free(s->lit[i]);
+    }
+    free(s->lit);
+    free(s->litlen);
+    free(s->klen);
+    free(s->hash);
+    free(s->nested);
+    free(s);
+}
+
+static int lept_parse_struct_object(lept_context* c, char* out, const lept_schema* s);
+
+static int lept_parse_struct_field(lept_context* c, char* p, const lept_schema* s, size_t i){
+    const lept_field_desc* d = &s->d[i];
+    lept_value tmp;
+    char* str;
+    size_t len;
+    int ret;
+    lept_init(&tmp);
+    if (*c->json == 'n')
+        return lept_parse_literal(c, &tmp, "null", LEPT_NULL);
+    switch (d->type){
+        case LEPT_FIELD_BOOL:
+            if (*c->json == 't')
+                ret = lept_parse_literal(c, &tmp, "true", LEPT_TRUE);
+            else if (*c->json == 'f')
+                ret = lept_parse_literal(c, &tmp, "false", LEPT_FALSE);
+            else
+                return LEPT_PARSE_SCHEMA_MISMATCH;
+            if (ret == LEPT_PARSE_OK)
+                *(int*)p = tmp.type == LEPT_TRUE;
+            return ret;
+        case LEPT_FIELD_INT:
+        case LEPT_FIELD_INT64:
+        case LEPT_FIELD_DOUBLE:
+            if (*c->json != '-' && !ISDIGIT(*c->json))
+                return LEPT_PARSE_SCHEMA_MISMATCH;
+            str = (char*)c->json;
+            if ((ret = lept_parse_number(c, &tmp)) != LEPT_PARSE_OK)
+                return ret;
+            for (len = (*str == '-'); str + len < c->json && ISDIGIT(str[len]); len++);
+            if (d->type == LEPT_FIELD_INT64 && str + len == c->json){
+                // plain integer: exact beyond 2^53, where the double isn't
+                char* end;
+                errno = 0;
+                *(long long*)p = strtoll(str, &end, 10);
+                return errno == ERANGE ? LEPT_PARSE_SCHEMA_MISMATCH : LEPT_PARSE_OK;
+            }
+            if (d->type == LEPT_FIELD_DOUBLE)
+                *(double*)p = tmp.u.n;
+            else if (d->type == LEPT_FIELD_INT){
+                // range first: converting an out-of-range double to int is undefined
+                if (tmp.u.n < INT_MIN || tmp.u.n > INT_MAX || tmp.u.n != (double)(int)tmp.u.n)
+                    return LEPT_PARSE_SCHEMA_MISMATCH;
+                *(int*)p = (int)tmp.u.n;
+            }else{
+                if (tmp.u.n < -9223372036854775808.0 || tmp.u.n >= 9223372036854775808.0 ||\
+                    tmp.u.n != (double)(long long)tmp.u.n)
+                    return LEPT_PARSE_SCHEMA_MISMATCH;
+                *(long long*)p = (long long)tmp.u.n;
+            }
+            return LEPT_PARSE_OK;
+        case LEPT_FIELD_STRING:
+        case LEPT_FIELD_CHARS:
+            if (*c->json != '\"')
+                return LEPT_PARSE_SCHEMA_MISMATCH;
+            if ((ret = lept_parse_string_raw(c, &str, &len)) != LEPT_PARSE_OK)
+                return ret;
+            if (d->type == LEPT_FIELD_STRING){
+                free(*(char**)p);
+                memcpy(*(char**)p = (char*)malloc(len + 1), str, len);
+                (*(char**)p)[len] = '\0';
+            }else{
+                if (len >= d->size)
+                    return LEPT_PARSE_SCHEMA_MISMATCH;
+                memcpy(p, str, len);
+                p[len] = '\0';
+            }
+            return LEPT_PARSE_OK;
+        case LEPT_FIELD_STRUCT:
+            if (*c->json != '{')
+                return LEPT_PARSE_SCHEMA_MISMATCH;
+            return lept_parse_struct_object(c, p, s->nested[i]);
+        case LEPT_FIELD_VALUE:
+            lept_free((lept_value*)p);
+            return lept_parse_value(c, (lept_value*)p);
+    }
+    return LEPT_PARSE_SCHEMA_MISMATCH;
+}
+
+static int lept_parse_struct_object(lept_context* c, char* out, const lept_schema* s){
+    EXPECT(c, '{');
+    lept_parse_whitespace(c);
+    if (*c->json == '}'){
+        c->json++;
+        return LEPT_PARSE_OK;
+    }
+    for (;;){
+        char* str;
+        size_t i, klen, hash;
+        int ret;
+        if (*c->json != '\"')
+            return LEPT_PARSE_MISS_KEY;
+        if ((ret = lept_parse_string_raw(c, &str, &klen)) != LEPT_PARSE_OK)
+            return ret;
+        hash = lept_hash_key(str, klen);
+        for (i = 0; i < s->n; i++)
+            if (s->hash[i] == hash && s->klen[i] == klen && memcmp(s->d[i].key, str, klen) == 0)
+                break;
+        lept_parse_whitespace(c);
+        if (*c->json != ':')
+            return LEPT_PARSE_MISS_COLON;
+        c->json++;
+        lept_parse_whitespace(c);
+        ret = i < s->n ? lept_parse_struct_field(c, out + s->d[i].offset, s, i) : lept_skip_value(c);
+        if (ret != LEPT_PARSE_OK)
+            return ret;
+        lept_parse_whitespace(c);
+        if (*c->json == ','){
+            c->json++;
+            lept_parse_whitespace(c);
+        }else if (*c->json == '}'){
+            c->json++;
+            return LEPT_PARSE_OK;
+        }else
+            return LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    }
+}
+
+/* on error the struct may be partially filled, release it with lept_free_struct() */
+int lept_parse_struct(void* out, const char* json, const lept_schema* s){
+    lept_context c;
+    int t;
+    assert(out != NULL && json != NULL && s != NULL);
+    c.json = json;
+    c.stack = NULL;
+    c.size = 0;
+    c.top = 0;
+    c.a = &lept_std_allocator;
+    c.strict_utf8 = 0;
+    c.lazy_numbers = 0;
+    c.end = NULL;
+    LEPT_CONTEXT_STATS(&c, NULL);
+    lept_parse_whitespace(&c);
+    if (*c.json != '{')
+        t = *c.json == '\0' ? LEPT_PARSE_EXPECT_VALUE : LEPT_PARSE_SCHEMA_MISMATCH;
+    else if ((t = lept_parse_struct_object(&c, (char*)out, s)) == LEPT_PARSE_OK){
+        lept_parse_whitespace(&c);
+        if (*c.json != '\0')
+            t = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    assert(c.top == 0);
+    free(c.stack);
+    return t;
+}
+
+void lept_free_struct(void* out, const lept_schema* s){
+    size_t i;
+    assert(out != NULL && s != NULL);
+    for (i = 0; i < s->n; i++){
+        char* p = (char*)out + s->d[i].offset;
+        switch (s->d[i].type){
+            case LEPT_FIELD_STRING:
+                free(*(char**)p);
+                *(char**)p = NULL;
+                break;
+            case LEPT_FIELD_STRUCT:
+                lept_free_struct(p, s->nested[i]);
+                break;
+            case LEPT_FIELD_VALUE:
+                lept_free((lept_value*)p);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+lept_type lept_get_type(const lept_value* v){
+    assert(v != NULL);
+    return v->type;
+}
+
+/* structural hash, equal values hash equal: object members are combined order-independently */
+static size_t lept_hash_value(const lept_value* v){
+    lept_header* h = NULL;
+    size_t i, hash;
+    double n;
+    switch (v->type){
+        case LEPT_NUMBER:
+            n = lept_get_number(v);
+            n = n == 0 ? 0 : n;         // -0 == 0
+            return lept_hash_key((const char*)&n, sizeof(n));
+        case LEPT_STRING:
+            return lept_hash_key(lept_get_string(v), lept_get_string_length(v)) ^ LEPT_STRING;
+        case LEPT_ARRAY:
+            if (v->u.a.e && (h = LEPT_HEADER(v->u.a.e))->hash_state == LEPT_HASH_CACHED)
+                return h->hash;
+            hash = LEPT_ARRAY;
+            for (i = 0; i < v->u.a.size; i++)
+                hash = (hash ^ lept_hash_value(&v->u.a.e[i])) * 1099511628211ULL;
+            break;
+        case LEPT_OBJECT:
+            if (v->u.o.m && (h = LEPT_HEADER(v->u.o.m))->hash_state == LEPT_HASH_CACHED)
+                return h->hash;
+            hash = LEPT_OBJECT;
+            for (i = 0; i < v->u.o.size; i++)
+                hash += (lept_hash_key(v->u.o.m[i].k, v->u.o.m[i].klen) * 31) ^ lept_hash_value(&v->u.o.m[i].v);
+            break;
+        default:
+            return v->type;
+    }
+    if (h != NULL && h->hash_state == LEPT_HASH_NONE){
+        h->hash = hash;
+        h->hash_state = LEPT_HASH_CACHED;
+    }
+    return hash;
+}
+
+size_t lept_hash(const lept_value* v){
+    assert(v != NULL);
+    return lept_hash_value(v);
+}
+
+/* both blocks have a hash cached, and they differ */
+static int lept_hash_differs(const void* lhs, const void* rhs){
+    const lept_header *a, *b;
+    if (lhs == NULL || rhs == NULL)
+        return 0;
+    a = LEPT_HEADER(lhs);
+    b = LEPT_HEADER(rhs);
+    return a->hash_state == LEPT_HASH_CACHED && b->hash_state == LEPT_HASH_CACHED && a->hash != b->hash;
+}
+
+int lept_is_equal(const lept_value* lhs, const lept_value* rhs){
+    assert(lhs != NULL);
+    assert(rhs != NULL);
+    size_t i;
+    if (lhs->type != rhs->type)
+        return 0;
+    switch (lhs->type){
+        case LEPT_STRING:
+            return lept_get_string_length(lhs) == lept_get_string_length(rhs) &&
+                memcmp(lept_get_string(lhs), lept_get_string(rhs), lept_get_string_length(lhs)) == 0;
+        case LEPT_NUMBER:
+            return lept_get_number(lhs) == lept_get_number(rhs);
+        case LEPT_ARRAY:
+            if (lhs->u.a.size != rhs->u.a.size || lept_hash_differs(lhs->u.a.e, rhs->u.a.e))
+                return 0;
+            for (i = 0; i < lhs->u.a.size; i++)
+                if (!lept_is_equal(&lhs->u.a.e[i], &rhs->u.a.e[i]))
+                    return 0;
+            return 1;
+        case LEPT_OBJECT:
+            if (lhs->u.o.size != rhs->u.o.size || lept_hash_differs(lhs->u.o.m, rhs->u.o.m))
+                return 0;
+            for (i = 0; i < lhs->u.o.size; i++){
+                size_t index = lept_find_object_index(rhs, lhs->u.o.m[i].k, lhs->u.o.m[i].klen);
+                if (index == LEPT_KEY_NOT_EXIST)
+                    return 0;
+                if (!lept_is_equal(&lhs->u.o.m[i].v, &rhs->u.o.m[index].v))
+                    return 0;
+            }
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+double lept_get_number(const lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_NUMBER);
+    if (v->flags & LEPT_FLAG_RAW_NUMBER){
+        // converted once, the double takes the place of the text
+        lept_value* w = (lept_value*)v;
+        double n = strtod(v->u.ss, NULL);
+        w->u.n = n;
+        w->flags = 0;
+    }
+    return v->u.n;
+}
+void lept_set_number(lept_value* v, double n){
+    assert(v != NULL);
+    lept_free(v);
+    v->type = LEPT_NUMBER;
+    v->u.n = n;
+    v->flags = 0;
+}
+
+/* heap strings: the text is preceded by the allocator it came from */
+static char* lept_string_alloc(size_t len){
+    const lept_allocator* a = lept_current_allocator();
+    const lept_allocator** p = (const lept_allocator**)a->alloc(a->ud, sizeof(const lept_allocator*) + len + 1);
+    *p = a;
+    return (char*)(p + 1);
+}
+
+static void lept_string_free(char* s){
+    const lept_allocator** p = (const lept_allocator**)s - 1;
+    (*p)->free((*p)->ud, p);
+}
+
+/* keys of object o come from, and go back to, the allocator of its member block */
+static char* lept_key_alloc(const lept_value* o, size_t klen){
+    const lept_allocator* a = LEPT_HEADER(o->u.o.m)->a;
+    return (char*)a->alloc(a->ud, klen + 1);
+}
+
+static void lept_key_free(const lept_value* o, char* k){
+    const lept_allocator* a = LEPT_HEADER(o->u.o.m)->a;
+    a->free(a->ud, k);
+}
+
+void lept_free(lept_value* v){
+    size_t i;
+    assert(v != NULL);
+    if (v->type == LEPT_STRING){
+        if (!(v->flags & LEPT_FLAG_INLINE_STRING))
+            lept_string_free(v->u.s.s);
+    }else if (v->type == LEPT_ARRAY){
+        for (i = 0; i < v->u.a.size; i++)
+            lept_free(&v->u.a.e[i]);
+        lept_block_free(v->u.a.e);
+    }else if(v->type == LEPT_OBJECT){
+        for (i = 0; i < v->u.o.size; i++){
+            lept_free(&v->u.o.m[i].v);
+            lept_key_free(v, v->u.o.m[i].k);
+        }
+        lept_block_free(v->u.o.m);
+    }
+    v->type = LEPT_NULL;
+}
+
+void lept_free_ex(lept_value* v, const lept_allocator* a){
+    const lept_allocator* saved = lept_scoped_allocator;
+    if (a != NULL)
+        lept_scoped_allocator = a;
+    lept_free(v);
+    lept_scoped_allocator = saved;
 }
 
 size_t lept_get_string_length(const lept_value* v){
     assert(v != NULL);
-    assert(v->type == LEPT_STRING);
-    return v->u.s.len;
+    assert(v->type == LEPT_STRING);
+    if (v->flags & LEPT_FLAG_INLINE_STRING)
+        return LEPT_SSO_CAPACITY - (unsigned char)v->u.ss[LEPT_SSO_CAPACITY];
+    return v->u.s.len;
+}
+const char* lept_get_string(const lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_STRING);
+    if (v->flags & LEPT_FLAG_INLINE_STRING)
+        return v->u.ss;
+    return v->u.s.s;
+}
+void lept_set_string(lept_value* v, const char* s, size_t len){
+    assert(v != NULL);
+    assert(s != NULL || len == 0);
+    lept_free(v);
+    if (len <= LEPT_SSO_CAPACITY){
+        // short string: no malloc, stored in the union itself
+        if (len > 0)
+            memcpy(v->u.ss, s, len);
+        v->u.ss[len] = '\0';
+        v->u.ss[LEPT_SSO_CAPACITY] = (char)(LEPT_SSO_CAPACITY - len);
+        v->flags = LEPT_FLAG_INLINE_STRING;
+    }else{
+        assert(len <= LEPT_SIZE_MAX);
+        v->u.s.s = lept_string_alloc(len);
+        memcpy(v->u.s.s, s, len);
+        v->u.s.s[len] = '\0';
+        v->u.s.len = len;
+        v->flags = 0;
+    }
+    v->type = LEPT_STRING;
+}
+
+void lept_set_boolean(lept_value* v, int b){
+    // assert(v != NULL);
+    lept_free(v);
+    if (b == 0)
+        v->type = LEPT_FALSE;
+    else
+        v->type = LEPT_TRUE;
+}
+int lept_get_boolean(const lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_TRUE || v->type == LEPT_FALSE);
+    return v->type == LEPT_TRUE;
+}
+
+size_t lept_get_array_size(const lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    return v->u.a.size;
+}
+
+lept_value* lept_get_array_element(const lept_value* v, size_t index){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    assert(index < v->u.a.size);
+    lept_hash_open(v);
+    return &v->u.a.e[index];
+}
+
+void lept_set_array(lept_value* v, size_t capacity){
+    assert(v != NULL);
+    lept_free(v);
+    v->type = LEPT_ARRAY;
+    v->u.a.size = 0;
+    v->u.a.e = (lept_value*)lept_block_realloc(NULL, capacity, sizeof(lept_value));
+}
+
+size_t lept_get_array_capacity(const lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    return lept_block_capacity(v->u.a.e);
+}
+
+void lept_reserve_array(lept_value* v, size_t capacity){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    if (lept_block_capacity(v->u.a.e) < capacity)
+        v->u.a.e = (lept_value*)lept_block_realloc(v->u.a.e, capacity, sizeof(lept_value));
+}
+
+void lept_shrink_array(lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    if (lept_block_capacity(v->u.a.e) > v->u.a.size)
+        v->u.a.e = (lept_value*)lept_block_realloc(v->u.a.e, v->u.a.size, sizeof(lept_value));
+}
+
+lept_value* lept_insert_array_elements(lept_value* v, size_t index, size_t count){
+    size_t i;
+    lept_value* e;
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    assert(index <= v->u.a.size);
+    v->u.a.e = (lept_value*)lept_block_grow(v->u.a.e, v->u.a.size, count, sizeof(lept_value));
+    lept_hash_open(v);
+    e = v->u.a.e + index;
+    if (count == 0)
+        return e;
+    memmove(e + count, e, (v->u.a.size - index) * sizeof(lept_value));
+    for (i = 0; i < count; i++)
+        lept_init(&e[i]);
+    v->u.a.size += count;
+    return e;
+}
+
+lept_value* lept_insert_array_element(lept_value* v, size_t index){
+    return lept_insert_array_elements(v, index, 1);
+}
+
+lept_value* lept_append_array_elements(lept_value* v, size_t count){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    return lept_insert_array_elements(v, v->u.a.size, count);
+}
+
+lept_value* lept_pushback_array_element(lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    if (v->u.a.size == lept_block_capacity(v->u.a.e))
+        v->u.a.e = (lept_value*)lept_block_grow(v->u.a.e, v->u.a.size, 1, sizeof(lept_value));
+    lept_hash_open(v);
+    lept_init(&v->u.a.e[v->u.a.size]);
+    return &v->u.a.e[v->u.a.size++];
+}
+
+void lept_popback_array_element(lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    assert(v->u.a.size > 0);
+    lept_hash_open(v);
+    lept_free(&v->u.a.e[--v->u.a.size]);
+}
+
+void lept_erase_array_element(lept_value* v, size_t index, size_t count){
+    size_t i;
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    assert(index + count <= v->u.a.size);
+    if (count == 0)
+        return;
+    lept_hash_open(v);
+    for (i = index; i < index + count; i++)
+        lept_free(&v->u.a.e[i]);
+    memmove(v->u.a.e + index, v->u.a.e + index + count,\
+            (v->u.a.size - index - count) * sizeof(lept_value));
+    v->u.a.size -= count;
+}
+
+void lept_clear_array(lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_ARRAY);
+    lept_erase_array_element(v, 0, v->u.a.size);
+}
+
+size_t lept_get_object_size(const lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    return v->u.o.size;
+}
+const char* lept_get_object_key(const lept_value* v, size_t index){
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    assert(index < v->u.o.size);
+    return v->u.o.m[index].k;
+}
+size_t lept_get_object_key_length(const lept_value* v, size_t index){
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    assert(index < v->u.o.size);
+    return v->u.o.m[index].klen;
+}
+lept_value* lept_get_object_value(const lept_value* v, size_t index){
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    assert(index < v->u.o.size);
+    lept_hash_open(v);
+    return &(v->u.o.m[index].v);
+}
+static size_t lept_index_find_slot(const lept_index* idx, const lept_member* m,\
+                                   const char* key, size_t klen, size_t hash){
+    size_t i = hash & idx->mask;
+    while (idx->slot[i].pos){
+        const lept_member* p = &m[idx->slot[i].pos - 1];
+        if (idx->slot[i].hash == hash && p->klen == klen && memcmp(p->k, key, klen) == 0)
+            return i;
+        i = (i + 1) & idx->mask;
+    }
+    return i;
+}
+
+static void lept_index_put(lept_index* idx, size_t hash, size_t pos){
+    size_t i = hash & idx->mask;
+    while (idx->slot[i].pos)
+        i = (i + 1) & idx->mask;
+    idx->slot[i].hash = hash;
+    idx->slot[i].pos = pos;
+}
+
+/* backward shift deletion, so no tombstones are needed */
+static void lept_index_delete_slot(lept_index* idx, size_t i){
+    size_t j = i, k;
+    for (;;){
+        j = (j + 1) & idx->mask;
+        if (idx->slot[j].pos == 0)
+            break;
+        k = idx->slot[j].hash & idx->mask;
+        // slot j stays if its home k lies cyclically in (i, j]
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        idx->slot[i] = idx->slot[j];
+        i = j;
+    }
+    idx->slot[i].pos = 0;
+}
+
+/* (re)build the index with at least twice as many slots as members */
+static void lept_index_build(const lept_value* v, size_t size){
+    lept_header* h = LEPT_HEADER(v->u.o.m);
+    lept_index* idx;
+    size_t i, slots = 8;
+    while (slots < size * 2)
+        slots <<= 1;
+    if (h->index)
+        h->a->free(h->a->ud, h->index);
+    idx = (lept_index*)h->a->alloc(h->a->ud, sizeof(lept_index) + slots * sizeof(lept_slot));
+    memset(idx, 0, sizeof(lept_index) + slots * sizeof(lept_slot));
+    idx->mask = slots - 1;
+    for (i = 0; i < v->u.o.size; i++){
+        const lept_member* m = &v->u.o.m[i];
+        size_t hash = lept_hash_key(m->k, m->klen);
+        size_t s = lept_index_find_slot(idx, v->u.o.m, m->k, m->klen, hash);
+        if (idx->slot[s].pos)
+            idx->dup = 1;   // keep the first one, as linear search does
+        else{
+            idx->slot[s].hash = hash;
+            idx->slot[s].pos = i + 1;
+        }
+    }
+    h->index = idx;
+}
+
+static void lept_index_drop(lept_value* v){
+    lept_header* h = v->u.o.m ? LEPT_HEADER(v->u.o.m) : NULL;
+    if (h && h->index){
+        h->a->free(h->a->ud, h->index);
+        h->index = NULL;
+    }
+}
+
+/* the member at index is about to leave, unlink its key */
+static void lept_index_remove(lept_value* v, size_t index){
+    lept_index* idx = LEPT_HEADER(v->u.o.m)->index;
+    const lept_member* m = &v->u.o.m[index];
+    size_t i, s;
+    if (idx == NULL)
+        return;
+    s = lept_index_find_slot(idx, v->u.o.m, m->k, m->klen, lept_hash_key(m->k, m->klen));
+    if (idx->slot[s].pos != index + 1)
+        return;     // a later duplicate, never indexed
+    lept_index_delete_slot(idx, s);
+    if (idx->dup){
+        // promote the next member with the same key
+        for (i = 0; i < v->u.o.size; i++)
+            if (i != index && v->u.o.m[i].klen == m->klen && memcmp(v->u.o.m[i].k, m->k, m->klen) == 0){
+                lept_index_put(idx, lept_hash_key(m->k, m->klen), i + 1);
+                break;
+            }
+    }
+}
+
+/* lookup through the index, hash is lept_hash_key(key, klen) */
+static size_t lept_find_object_index_hashed(const lept_value* v,\
+                                            const char* key,\
+                                            size_t klen,\
+                                            size_t hash){
+    size_t i;
+    lept_index* idx = LEPT_HEADER(v->u.o.m)->index;
+    if (idx == NULL){
+        lept_index_build(v, lept_block_capacity(v->u.o.m));
+        idx = LEPT_HEADER(v->u.o.m)->index;
+    }
+    i = lept_index_find_slot(idx, v->u.o.m, key, klen, hash);
+    return idx->slot[i].pos ? idx->slot[i].pos - 1 : LEPT_KEY_NOT_EXIST;
+}
+
+size_t lept_find_object_index(const lept_value* v,\
+                              const char* key,\
+                              size_t klen){
+    size_t i;
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    assert(key != NULL);
+    if (v->u.o.size >= LEPT_OBJECT_INDEX_THRESHOLD)
+        return lept_find_object_index_hashed(v, key, klen, lept_hash_key(key, klen));
+    for (i = 0; i < v->u.o.size; i++)
+        if (v->u.o.m[i].klen == klen && memcmp(v->u.o.m[i].k, key, klen) == 0)
+            return i;
+    return LEPT_KEY_NOT_EXIST;
+}
+lept_value* lept_find_object_value(lept_value* v,\
+                                   const char* key,\
+                                   size_t klen){
+    size_t index = lept_find_object_index(v, key, klen);
+    if (index == LEPT_KEY_NOT_EXIST)
+        return NULL;
+    lept_hash_open(v);
+    return &v->u.o.m[index].v;
+}
+
+void lept_build_index(lept_value* v){
+    size_t i;
+    assert(v != NULL);
+    lept_hash_open(v);
+    if (v->type == LEPT_NUMBER)
+        lept_get_number(v);
+    else if (v->type == LEPT_ARRAY)
+        for (i = 0; i < v->u.a.size; i++)
+            lept_build_index(&v->u.a.e[i]);
+    else if (v->type == LEPT_OBJECT){
+        if (v->u.o.size >= LEPT_OBJECT_INDEX_THRESHOLD && LEPT_HEADER(v->u.o.m)->index == NULL)
+            lept_index_build(v, lept_block_capacity(v->u.o.m));
+        for (i = 0; i < v->u.o.size; i++)
+            lept_build_index(&v->u.o.m[i].v);
+    }
+}
+
+void lept_set_object(lept_value* v, size_t capacity){
+    assert(v != NULL);
+    lept_free(v);
+    v->type = LEPT_OBJECT;
+    v->u.o.size = 0;
+    v->u.o.m = (lept_member*)lept_block_realloc(NULL, capacity, sizeof(lept_member));
+}
+size_t lept_get_object_capacity(const lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    return lept_block_capacity(v->u.o.m);
+}
+void lept_reserve_object(lept_value* v, size_t capacity){
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    if (lept_block_capacity(v->u.o.m) < capacity)
+        v->u.o.m = (lept_member*)lept_block_realloc(v->u.o.m, capacity, sizeof(lept_member));
+}
+void lept_shrink_object(lept_value* v){
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    if (lept_block_capacity(v->u.o.m) > v->u.o.size)
+        v->u.o.m = (lept_member*)lept_block_realloc(v->u.o.m, v->u.o.size, sizeof(lept_member));
+}
+void lept_clear_object(lept_value* v){
+    size_t i;
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    lept_hash_open(v);
+    for (i = 0; i < v->u.o.size; i++){
+        lept_key_free(v, v->u.o.m[i].k);
+        lept_free(&v->u.o.m[i].v);
+    }
+    v->u.o.size = 0;
+    lept_index_drop(v);
+}
+lept_value* lept_set_object_value(lept_value* v,\
+                                  const char* key,\
+                                  size_t klen){
+    size_t index;
+    lept_member* m;
+    lept_index* idx;
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    assert(key != NULL);
+    if ((index = lept_find_object_index(v, key, klen)) != LEPT_KEY_NOT_EXIST){
+        lept_hash_open(v);
+        return &v->u.o.m[index].v;
+    }
+    v->u.o.m = (lept_member*)lept_block_grow(v->u.o.m, v->u.o.size, 1, sizeof(lept_member));
+    lept_hash_open(v);
+    m = &v->u.o.m[v->u.o.size++];
+    memcpy(m->k = lept_key_alloc(v, klen), key, klen);
+    m->k[klen] = '\0';
+    m->klen = klen;
+    lept_init(&m->v);
+    if ((idx = LEPT_HEADER(v->u.o.m)->index) != NULL){
+        if (v->u.o.size * 2 > idx->mask + 1)
+            lept_index_build(v, v->u.o.size);
+        else
+            lept_index_put(idx, lept_hash_key(key, klen), v->u.o.size);
+    }
+    return &m->v;
+}
+/* unlinks the member at index keeping member order, out (if any) takes its key and value */
+static void lept_take_object_member(lept_value* v, size_t index, lept_member* out){
+    lept_index* idx;
+    size_t i;
+    lept_hash_open(v);
+    lept_index_remove(v, index);
+    if (out != NULL)
+        memcpy(out, &v->u.o.m[index], sizeof(lept_member));
+    else{
+        lept_key_free(v, v->u.o.m[index].k);
+        lept_free(&v->u.o.m[index].v);
+    }
+    memmove(v->u.o.m + index, v->u.o.m + index + 1,\
+            (v->u.o.size - index - 1) * sizeof(lept_member));
+    v->u.o.size--;
+    if ((idx = LEPT_HEADER(v->u.o.m)->index) != NULL)
+        for (i = 0; i <= idx->mask; i++)
+            if (idx->slot[i].pos > index + 1)
+                idx->slot[i].pos--;
+}
+/* puts a taken member back at index, the key index is rebuilt lazily */
+static void lept_insert_object_member(lept_value* v, size_t index, const lept_member* m){
+    assert(index <= v->u.o.size);
+    v->u.o.m = (lept_member*)lept_block_grow(v->u.o.m, v->u.o.size, 1, sizeof(lept_member));
+    lept_hash_open(v);
+    memmove(v->u.o.m + index + 1, v->u.o.m + index, (v->u.o.size - index) * sizeof(lept_member));
+    memcpy(&v->u.o.m[index], m, sizeof(lept_member));
+    v->u.o.size++;
+    lept_index_drop(v);
+}
+/* keeps member order, O(n) */
+void lept_remove_object_value(lept_value* v, size_t index){
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    assert(index < v->u.o.size);
+    lept_take_object_member(v, index, NULL);
+}
+/* moves the last member into the hole, O(1) */
+void lept_swap_remove_object_value(lept_value* v, size_t index){
+    lept_index* idx;
+    size_t last, s;
+    assert(v != NULL);
+    assert(v->type == LEPT_OBJECT);
+    assert(index < v->u.o.size);
+    lept_hash_open(v);
+    lept_index_remove(v, index);
+    lept_key_free(v, v->u.o.m[index].k);
+    lept_free(&v->u.o.m[index].v);
+    last = v->u.o.size - 1;
+    if (index != last){
+        idx = LEPT_HEADER(v->u.o.m)->index;
+        if (idx != NULL){
+            const lept_member* m = &v->u.o.m[last];
+            s = lept_index_find_slot(idx, v->u.o.m, m->k, m->klen, lept_hash_key(m->k, m->klen));
+            if (idx->slot[s].pos == last + 1)
+                idx->slot[s].pos = index + 1;
+        }
+        memcpy(&v->u.o.m[index], &v->u.o.m[last], sizeof(lept_member));
+    }
+    v->u.o.size--;
+}
+
+
+
+static const char lept_hex_upper[] = "0123456789ABCDEF";
+static const char lept_hex_lower[] = "0123456789abcdef";
+
+static void lept_stringify_string_hex(lept_context* c,\
+                                const char* s,\
+                                size_t len,\
+                                const char* hex_digits){
+    /* ... */
+    size_t i, size;
+    char* buf, *head;
+    assert(s != NULL);
+    size = len * 6 + 2;
+    head = lept_context_push(c, size);
+    buf = head;
+    *buf++ = '\"';
+    for (i = 0; i < len; i++){
+        unsigned char ch = (unsigned char)s[i];
+        switch (ch){
+            case '\"':  *buf++ = '\\'; *buf++ = '\"'; break;
+            case '\\':  *buf++ = '\\'; *buf++ = '\\'; break;
+            case '\b':  *buf++ = '\\'; *buf++ = 'b'; break;
+            case '\f':  *buf++ = '\\'; *buf++ = 'f'; break;
+            case '\n':  *buf++ = '\\'; *buf++ = 'n'; break;
+            case '\r':  *buf++ = '\\'; *buf++ = 'r'; break;
+            case '\t':  *buf++ = '\\'; *buf++ = 't'; break;
+            default:
+                if (ch < 0x20){
+                    *buf++ = '\\'; *buf++ = 'u'; *buf++ = '0'; *buf++ = '0';
+                    *buf++ = hex_digits[ch >> 4];
+                    *buf++ = hex_digits[ch & 15];
+                }
+                else
+                    *buf++ = ch;
+                    // *buf++ = s[i];
+        }
+    }
+    *buf++ = '\"';
+    c->top -= size - (buf - head);
+}
+
+static void lept_stringify_string(lept_context* c, const char* s, size_t len){
+    lept_stringify_string_hex(c, s, len, lept_hex_upper);
+}
+
+static void lept_stringify_value(lept_context* c, const lept_value* v){
+    size_t i;
+    switch (v->type){
+        case LEPT_NULL:     PUTS(c, "null", 4); break;
+        case LEPT_FALSE:    PUTS(c, "false", 5); break;
+        case LEPT_TRUE:     PUTS(c, "true", 4); break;
+        case LEPT_NUMBER:
+            if (v->flags & LEPT_FLAG_RAW_NUMBER){
+                // not read or set since parsing: the source text as it was
+                PUTS(c, v->u.ss, LEPT_SSO_CAPACITY - (unsigned char)v->u.ss[LEPT_SSO_CAPACITY]);
+                break;
+            }
+            // char* buf = lept_context_push(c, 32);
+            // int len = sprintf(buf, "%.17g", v->u.n);
+            // c->top -= 32 - len;
+            c->top -= 32 - sprintf(lept_context_push(c, 32), "%.17g", v->u.n);
+            break;
+        case LEPT_STRING:   lept_stringify_string(c, lept_get_string(v), lept_get_string_length(v)); break;
+        case LEPT_ARRAY:
+            /* ... */
+            PUTC(c, '[');
+            for (i = 0; i < v->u.a.size; i++){
+                if (i > 0)
+                    PUTC(c, ',');
+                lept_stringify_value(c, &v->u.a.e[i]);
+            }
+            PUTC(c, ']');
+            break;
+        case LEPT_OBJECT:
+            /* ... */
+            PUTC(c, '{');
+            for (i = 0; i < v->u.o.size; i++){
+                if (i > 0)
+                    PUTC(c, ',');
+                lept_stringify_string(c, v->u.o.m[i].k, v->u.o.m[i].klen);
+                PUTC(c, ':');
+                lept_stringify_value(c, &v->u.o.m[i].v);
+            }
+            PUTC(c, '}');
+            break;
+        default: assert(0 && "invalid type");
+    }
+}
+
+/*
+ *  RFC 8785 (JCS) canonical form: members sorted by key in UTF-16 code unit order, numbers the way
+ *  ECMAScript prints them (shortest round-trip digits), only the escapes JSON requires
+ */
+
+/* UTF-16 order is UTF-8 byte order, except that U+10000 and up (surrogate pairs) sort before U+E000..U+FFFF */
+static int lept_canonical_key_compare(const void* lhs, const void* rhs){
+    const lept_member* a = *(const lept_member* const*)lhs;
+    const lept_member* b = *(const lept_member* const*)rhs;
+    size_t i, n = a->klen < b->klen ? a->klen : b->klen;
+    unsigned char ca, cb;
+    for (i = 0; i < n && a->k[i] == b->k[i]; i++)
+        ;
+    if (i == n){
+        if (a->klen != b->klen)
+            return a->klen < b->klen ? -1 : 1;
+        return (a > b) - (a < b);   // duplicated keys keep their order
+    }
+    // the bytes differ at a lead byte unless both are in the same (length of) sequence
+    ca = (unsigned char)a->k[i];
+    cb = (unsigned char)b->k[i];
+    if (ca >= 0xF0 && (cb == 0xEE || cb == 0xEF))
+        return -1;
+    if (cb >= 0xF0 && (ca == 0xEE || ca == 0xEF))
+        return 1;
+    return ca < cb ? -1 : 1;
+}
+
+static void lept_stringify_canonical_number(lept_context* c, double n){
+    char buf[32], digits[18], *p;
+    int prec, k = 0, point, i;
+    if (n == 0 || n != n || n - n != 0){
+        // -0 prints as 0, NaN and infinities aren't JSON, left as lept_stringify has them
+        if (n == 0)
+            PUTC(c, '0');
+        else
+            c->top -= 32 - sprintf(lept_context_push(c, 32), "%.17g", n);
+        return;
+    }
+    for (prec = 1; prec < 17; prec++){
+        sprintf(buf, "%.*e", prec - 1, n);
+        if (strtod(buf, NULL) == n)
+            break;
+    }
+    sprintf(buf, "%.*e", prec - 1, n);
+    p = buf;
+    if (*p == '-'){
+        PUTC(c, '-');
+        p++;
+    }
+    for (; *p != 'e'; p++)
+        if (*p != '.')
+            digits[k++] = *p;
+    point = atoi(p + 1) + 1;    // digits[0, point) is the integer part
+    if (k <= point && point <= 21){
+        PUTS(c, digits, k);
+        for (i = k; i < point; i++)
+            PUTC(c, '0');
+    }else if (0 < point && point <= 21){
+        PUTS(c, digits, point);
+        PUTC(c, '.');
+        PUTS(c, digits + point, k - point);
+    }else if (-6 < point && point <= 0){
+        PUTS(c, "0.", 2);
+        for (i = point; i < 0; i++)
+            PUTC(c, '0');
+        PUTS(c, digits, k);
+    }else{
+        PUTC(c, digits[0]);
+        if (k > 1){
+            PUTC(c, '.');
+            PUTS(c, digits + 1, k - 1);
+        }
+        c->top -= 16 - sprintf(lept_context_push(c, 16), "e%+d", point - 1);
+    }
+}
+
+static void lept_stringify_canonical(lept_context* c, const lept_value* v){
+    const lept_member *small[16], **m;
+    size_t i;
+    switch (v->type){
+        case LEPT_NUMBER:
+            lept_stringify_canonical_number(c, lept_get_number(v));
+            break;
+        case LEPT_STRING:
+            lept_stringify_string_hex(c, lept_get_string(v), lept_get_string_length(v), lept_hex_lower);
+            break;
+        case LEPT_ARRAY:
+            PUTC(c, '[');
+            for (i = 0; i < v->u.a.size; i++){
+                if (i > 0)
+                    PUTC(c, ',');
+                lept_stringify_canonical(c, &v->u.a.e[i]);
+            }
+            PUTC(c, ']');
+            break;
+        case LEPT_OBJECT:
+            // members stay where they are, only pointers to them are sorted
+            m = v->u.o.size <= sizeof(small) / sizeof(small[0]) ? small : (const lept_member**)malloc(v->u.o.size * sizeof(lept_member*));
+            for (i = 0; i < v->u.o.size; i++)
+                m[i] = &v->u.o.m[i];
+            qsort(m, v->u.o.size, sizeof(lept_member*), lept_canonical_key_compare);
+            PUTC(c, '{');
+            for (i = 0; i < v->u.o.size; i++){
+                if (i > 0)
+                    PUTC(c, ',');
+                lept_stringify_string_hex(c, m[i]->k, m[i]->klen, lept_hex_lower);
+                PUTC(c, ':');
+                lept_stringify_canonical(c, &m[i]->v);
+            }
+            PUTC(c, '}');
+            if (m != small)
+                free((void*)m);
+            break;
+        default:
+            lept_stringify_value(c, v);
+            break;
+    }
+}
+
+char* lept_stringify_ex(const lept_value* v, size_t* length, const lept_stringify_options* opt){
+    lept_context c;
+    char* json;
+    int cached;
+    LEPT_STAT_TIME(start);
+    assert(v != NULL);
+    if (!(cached = lept_context_acquire(&c))){
+        c.stack = (char*)malloc(c.size = LEPT_PARSE_STRINGIFY_INIT_SIZE);
+        c.top = 0;
+        c.a = &lept_std_allocator;   // the result is handed out, callers free() it
+    }
+    LEPT_CONTEXT_STATS(&c, opt != NULL ? opt->stats : NULL);
+    LEPT_STAT_ADD(&c, mallocs, 1);
+    if (opt != NULL && opt->canonical)
+        lept_stringify_canonical(&c, v);
+    else
+        lept_stringify_value(&c, v);
+    if (length)
+        *length = c.top;
+    LEPT_STAT_ADD(&c, output_bytes, c.top);
+    PUTC(&c, '\0');
+    if (cached){
+        // the cached stack stays, the caller gets an exact-size copy
+        memcpy(json = (char*)malloc(c.top), c.stack, c.top);
+        lept_context_release(&c);
+    }else
+        json = c.stack;
+    LEPT_STAT_ELAPSED(&c, stringify_time, start);
+    return json;
+}
+
+char* lept_stringify(const lept_value* v, size_t* length){
+    return lept_stringify_ex(v, length, NULL);
+}
+
+/*
+ *  descriptor-driven serialization, every key is a single memcpy of its pre-escaped literal
+ */
+static void lept_stringify_struct_object(lept_context* c, const char* in, const lept_schema* s){
+    size_t i;
+    PUTC(c, '{');
+    for (i = 0; i < s->n; i++){
+        const lept_field_desc* d = &s->d[i];
+        const char* p = in + d->offset;
+        if (i > 0)
+            PUTC(c, ',');
+        PUTS(c, s->lit[i], s->litlen[i]);
+        switch (d->type){
+            case LEPT_FIELD_BOOL:
+                if (*(const int*)p)
+                    PUTS(c, "true", 4);
+                else
+                    PUTS(c, "false", 5);
+                break;
+            case LEPT_FIELD_INT:
+                c->top -= 32 - sprintf(lept_context_push(c, 32), "%d", *(const int*)p);
+                break;
+            case LEPT_FIELD_INT64:
+                c->top -= 32 - sprintf(lept_context_push(c, 32), "%lld", *(const long long*)p);
+                break;
+            case LEPT_FIELD_DOUBLE:
+                c->top -= 32 - sprintf(lept_context_push(c, 32), "%.17g", *(const double*)p);
+                break;
+            case LEPT_FIELD_STRING:
+                if (*(char* const*)p)
+                    lept_stringify_string(c, *(char* const*)p, strlen(*(char* const*)p));
+                else
+                    PUTS(c, "null", 4);
+                break;
+            case LEPT_FIELD_CHARS:
+                lept_stringify_string(c, p, strlen(p));
+                break;
+            case LEPT_FIELD_STRUCT:
+                lept_stringify_struct_object(c, p, s->nested[i]);
+                break;
+            case LEPT_FIELD_VALUE:
+                lept_stringify_value(c, (const lept_value*)p);
+                break;
+        }
+    }
+    PUTC(c, '}');
+}
+
+char* lept_stringify_struct(const void* in, const lept_schema* s, size_t* length){
+    lept_context c;
+    assert(in != NULL && s != NULL);
+    c.stack = (char*)malloc(c.size = LEPT_PARSE_STRINGIFY_INIT_SIZE);
+    c.top = 0;
+    c.a = &lept_std_allocator;
+    LEPT_CONTEXT_STATS(&c, NULL);
+    lept_stringify_struct_object(&c, (const char*)in, s);
+    if (length)
+        *length = c.top;
+    PUTC(&c, '\0');
+    return c.stack;
+}
+
+void lept_copy(lept_value* dst, const lept_value* src){
+    size_t i;
+    assert(src != NULL);
+    assert(dst != NULL);
+    assert(src != NULL);
+    switch (src->type){
+        case LEPT_STRING:
+            lept_set_string(dst, lept_get_string(src), lept_get_string_length(src));
+            break;
+        case LEPT_ARRAY:
+            lept_set_array(dst, src->u.a.size);
+            // filled in place, a fresh block keeps caching its hash
+            for (i = 0; i < src->u.a.size; i++){
+                lept_init(&dst->u.a.e[dst->u.a.size]);
+                lept_copy(&dst->u.a.e[dst->u.a.size++], &src->u.a.e[i]);
+            }
+            break;
+        case LEPT_OBJECT:
+            // members are appended as-is (duplicated keys included), the index is rebuilt lazily
+            lept_set_object(dst, src->u.o.size);
+            for (i = 0; i < src->u.o.size; i++){
+                lept_member* m = &dst->u.o.m[dst->u.o.size++];
+                memcpy(m->k = lept_key_alloc(dst, src->u.o.m[i].klen), src->u.o.m[i].k, src->u.o.m[i].klen + 1);
+                m->klen = src->u.o.m[i].klen;
+                lept_init(&m->v);
+                lept_copy(&m->v, &src->u.o.m[i].v);
+            }
+            break;
+        default:
+            lept_free(dst);
+            memcpy(dst, src, sizeof(lept_value));
+            break;
+    }
+}
+
+void lept_move(lept_value* dst, lept_value* src){
+    assert(dst != NULL && src != NULL && src != dst);
+    lept_free(dst);
+    memcpy(dst, src, sizeof(lept_value));
+    lept_init(src);
+}
+
+void lept_swap(lept_value* lhs, lept_value* rhs){
+    assert(lhs != NULL && rhs != NULL);
+    if (lhs != rhs){
+        lept_value temp;
+        memcpy(&temp, lhs, sizeof(lept_value));
+        memcpy(lhs,   rhs, sizeof(lept_value));
+        memcpy(rhs, &temp, sizeof(lept_value));
+    }
+}
+
+/*
+ *  RFC 6901 JSON Pointer
+ *  tokens are unescaped, array indices parsed and keys hashed once at compile time
+ */
+
+struct lept_pointer_batch {
+    size_t n, depth;    // depth: max token count
+    lept_pointer** p;   // in the caller's order
+    size_t* order;      // resolution order, pointers sorted by tokens
+    size_t* shared;     // tokens shared with the previous pointer in order
+};
+
+static size_t lept_token_index(const char* s, size_t len){
+    size_t i, index = 0;
+    if (len == 0 || (len > 1 && s[0] == '0'))
+        return LEPT_KEY_NOT_EXIST;
+    for (i = 0; i < len; i++){
+        if (!ISDIGIT(s[i]) || index > (LEPT_KEY_NOT_EXIST - 10) / 10)
+            return LEPT_KEY_NOT_EXIST;
+        index = index * 10 + (s[i] - '0');
+    }
+    return index;
+}
+
+lept_pointer* lept_pointer_compile(const char* pointer){
+    lept_pointer* p;
+    const char* s;
+    char* k;
+    size_t i, n = 0, len;
+    assert(pointer != NULL);
+    if (*pointer != '\0' && *pointer != '/')
+        return NULL;
+    for (s = pointer; *s; s++){
+        if (*s == '/')
+            n++;
+        else if (*s == '~' && s[1] != '0' && s[1] != '1')
+            return NULL;
+    }
+    len = s - pointer;
+    // one block: header, tokens, unescaped keys
+    p = (lept_pointer*)malloc(sizeof(lept_pointer) + n * sizeof(lept_token) + len + 1);
+    p->n = n;
+    p->t = (lept_token*)(p + 1);
+    k = (char*)(p->t + n);
+    for (i = 0, s = pointer; i < n; i++){
+        lept_token* t = &p->t[i];
+        t->key = k;
+        for (s++; *s && *s != '/'; s++){
+            if (*s == '~')
+                *k++ = *++s == '0' ? '~' : '/';
+            else
+                *k++ = *s;
+        }
+        t->klen = k - t->key;
+        t->hash = lept_hash_key(t->key, t->klen);
+        t->index = lept_token_index(t->key, t->klen);
+        *k++ = '\0';
+    }
+    return p;
+}
+
+void lept_pointer_free(lept_pointer* p){
+    free(p);
+}
+
+static lept_value* lept_pointer_step(const lept_value* v, const lept_token* t){
+    size_t i;
+    lept_hash_open(v);
+    if (v->type == LEPT_OBJECT){
+        if (v->u.o.size >= LEPT_OBJECT_INDEX_THRESHOLD)
+            i = lept_find_object_index_hashed(v, t->key, t->klen, t->hash);
+        else
+            i = lept_find_object_index(v, t->key, t->klen);
+        return i != LEPT_KEY_NOT_EXIST ? &v->u.o.m[i].v : NULL;
+    }
+    if (v->type == LEPT_ARRAY && t->index < v->u.a.size)
+        return &v->u.a.e[t->index];
+    return NULL;
+}
+
+lept_value* lept_pointer_get(const lept_value* doc, const lept_pointer* p){
+    size_t i;
+    lept_value* v = (lept_value*)doc;
+    assert(doc != NULL && p != NULL);
+    for (i = 0; i < p->n && v != NULL; i++)
+        v = lept_pointer_step(v, &p->t[i]);
+    return v;
+}
+
+static int lept_token_compare(const lept_token* a, const lept_token* b){
+    int r = memcmp(a->key, b->key, a->klen < b->klen ? a->klen : b->klen);
+    return r ? r : (a->klen > b->klen) - (a->klen < b->klen);
+}
+
+typedef struct {
+    const lept_pointer* p;
+    size_t i;
+}lept_pointer_entry;
+
+static int lept_pointer_compare(const void* lhs, const void* rhs){
+    const lept_pointer* a = ((const lept_pointer_entry*)lhs)->p;
+    const lept_pointer* b = ((const lept_pointer_entry*)rhs)->p;
+    size_t i;
+    int r;
+    for (i = 0; i < a->n && i < b->n; i++)
+        if ((r = lept_token_compare(&a->t[i], &b->t[i])) != 0)
+            return r;
+    return (a->n > b->n) - (a->n < b->n);
+}
+
+lept_pointer_batch* lept_pointer_batch_compile(const char* const* pointers, size_t n){
+    lept_pointer_batch* b;
+    lept_pointer_entry* e;
+    size_t i, j;
+    assert(pointers != NULL || n == 0);
+    b = (lept_pointer_batch*)malloc(sizeof(lept_pointer_batch));
+    b->n = n;
+    b->depth = 0;
+    b->p = (lept_pointer**)calloc(n ? n : 1, sizeof(lept_pointer*));
+    b->order = (size_t*)malloc((n ? n : 1) * sizeof(size_t));
+    b->shared = (size_t*)malloc((n ? n : 1) * sizeof(size_t));
+    for (i = 0; i < n; i++){
+        if ((b->p[i] = lept_pointer_compile(pointers[i])) == NULL){
+            lept_pointer_batch_free(b);
+            return NULL;
+        }
+        if (b->p[i]->n > b->depth)
+            b->depth = b->p[i]->n;
+    }
+    // sorting once puts pointers with common prefixes next to each other
+    e = (lept_pointer_entry*)malloc((n ? n : 1) * sizeof(lept_pointer_entry));
+    for (i = 0; i < n; i++){
+        e[i].p = b->p[i];
+        e[i].i = i;
+    }
+    qsort(e, n, sizeof(lept_pointer_entry), lept_pointer_compare);
+    for (i = 0; i < n; i++)
+        b->order[i] = e[i].i;
+    free(e);
+    for (i = 0; i < n; i++){
+        const lept_pointer* cur = b->p[b->order[i]];
+        const lept_pointer* prev = i ? b->p[b->order[i - 1]] : NULL;
+        for (j = 0; prev && j < cur->n && j < prev->n; j++)
+            if (lept_token_compare(&cur->t[j], &prev->t[j]) != 0)
+                break;
+        b->shared[i] = j;
+    }
+    return b;
+}
+
+void lept_pointer_batch_free(lept_pointer_batch* b){
+    size_t i;
+    if (b == NULL)
+        return;
+    for (i = 0; i < b->n; i++)
+        lept_pointer_free(b->p[i]);
+    free(b->p);
+    free(b->order);
+    free(b->shared);
+    free(b);
+}
+
+/*
+ *  out[i] receives the value of the i-th pointer (or NULL),
+ *  a common prefix is walked once for all pointers sharing it
+ */
+void lept_pointer_batch_get(const lept_value* doc, const lept_pointer_batch* b, lept_value** out){
+    lept_value* stack[32];
+    lept_value** path = stack;
+    size_t i, j;
+    assert(doc != NULL && b != NULL && out != NULL);
+    if (b->depth + 1 > sizeof(stack) / sizeof(stack[0]))
+        path = (lept_value**)malloc((b->depth + 1) * sizeof(lept_value*));
+    path[0] = (lept_value*)doc;
+    for (i = 0; i < b->n; i++){
+        const lept_pointer* p = b->p[b->order[i]];
+        // path[0..shared] is still valid from the previous pointer
+        for (j = b->shared[i]; j < p->n && path[j] != NULL; j++)
+            path[j + 1] = lept_pointer_step(path[j], &p->t[j]);
+        for (; j < p->n; j++)
+            path[j + 1] = NULL;
+        out[b->order[i]] = path[p->n];
+    }
+    if (path != stack)
+        free(path);
+}
+
+/*
+ *  JSONPath subset, compiled into a list of steps:
+ *  $  .name  ['name']  [n]  [start:end:step]  .*  [*]  ..step  [?(@.rel op literal)]  [?(@.rel)]
+ */
+typedef enum { LEPT_QUERY_CHILD, LEPT_QUERY_INDEX, LEPT_QUERY_WILDCARD, LEPT_QUERY_SLICE, LEPT_QUERY_FILTER } lept_query_op;
+typedef enum { LEPT_CMP_EXISTS, LEPT_CMP_EQ, LEPT_CMP_NE, LEPT_CMP_LT, LEPT_CMP_LE, LEPT_CMP_GT, LEPT_CMP_GE } lept_query_cmp;
+
+#define LEPT_SLICE_HAS_START 1
+#define LEPT_SLICE_HAS_END   2
+
+typedef struct {
+    lept_query_op op;
+    int descend;            // preceded by '..'
+    lept_token t;           // CHILD
+    long start, end, step;  // INDEX (start), SLICE
+    int flags;              // SLICE: LEPT_SLICE_HAS_*
+    lept_token* rel;        // FILTER: path relative to '@'
+    size_t nrel;
+    lept_query_cmp cmp;
+    lept_value literal;
+}lept_query_step;
+
+struct lept_query {
+    size_t n;
+    lept_query_step* s;
+};
+
+static void lept_query_skip_ws(const char** p){
+    while (**p == ' ')
+        (*p)++;
+}
+
+static int lept_query_parse_int(const char** p, long* n){
+    const char* s = *p;
+    char* end;
+    if (*s == '-')
+        s++;
+    if (!ISDIGIT(*s))
+        return 0;
+    *n = strtol(*p, &end, 10);
+    *p = end;
+    return 1;
+}
+
+/* name after '.', or a quoted name inside brackets (quote is ' or ") */
+static int lept_query_parse_name(const char** p, lept_token* t, char quote){
+    const char* s = *p;
+    char* k;
+    size_t len = 0;
+    if (quote){
+        for (s++; *s != quote; s++, len++){
+            if (*s == '\0')
+                return 0;
+            if (*s == '\\' && s[1] != '\0')
+                s++;
+        }
+        t->key = k = (char*)malloc(len + 1);
+        for (s = *p + 1; *s != quote; s++)
+            *k++ = *s == '\\' ? *++s : *s;
+        s++;
+    }else{
+        while (s[len] && !strchr(".[ )=!<>", s[len]))
+            len++;
+        if (len == 0)
+            return 0;
+        t->key = k = (char*)malloc(len + 1);
+        memcpy(k, s, len);
+        k += len;
+        s += len;
+    }
+    *k = '\0';
+    t->klen = len;
+    t->hash = lept_hash_key(t->key, len);
+    t->index = LEPT_KEY_NOT_EXIST;
+    *p = s;
+    return 1;
+}
+
+static int lept_query_parse_literal(const char** p, lept_value* v){
+    const char* s = *p;
+    lept_token t;
+    if (*s == '\'' || *s == '\"'){
+        if (!lept_query_parse_name(p, &t, *s))
+            return 0;
+        lept_set_string(v, t.key, t.klen);
+        free((char*)t.key);
+        return 1;
+    }
+    if (strncmp(s, "true", 4) == 0)       { lept_set_boolean(v, 1); *p += 4; return 1; }
+    if (strncmp(s, "false", 5) == 0)      { lept_set_boolean(v, 0); *p += 5; return 1; }
+    if (strncmp(s, "null", 4) == 0)       { lept_free(v); *p += 4; return 1; }
+    if (*s == '-' || ISDIGIT(*s)){
+        char* end;
+        lept_set_number(v, strtod(s, &end));
+        *p = end;
+        return 1;
+    }
+    return 0;
+}
+
+/* ?(@.a.b[0] op literal) */
+static int lept_query_parse_filter(const char** p, lept_query_step* st){
+    const char* s = *p;
+    size_t cap = 0;
+    static const struct { const char* s; lept_query_cmp cmp; } ops[] = {
+        { "==", LEPT_CMP_EQ }, { "!=", LEPT_CMP_NE }, { "<=", LEPT_CMP_LE },
+        { ">=", LEPT_CMP_GE }, { "<", LEPT_CMP_LT }, { ">", LEPT_CMP_GT }
+    };
+    size_t i;
+    st->op = LEPT_QUERY_FILTER;
+    st->cmp = LEPT_CMP_EXISTS;
+    if (*s++ != '(')
+        return 0;
+    lept_query_skip_ws(&s);
+    if (*s++ != '@')
+        return 0;
+    for (;;){
+        lept_token t;
+        long n;
+        if (*s == '.'){
+            s++;
+            if (!lept_query_parse_name(&s, &t, 0))
+                return 0;
+        }else if (*s == '['){
+            s++;
+            if (*s == '\'' || *s == '\"'){
+                if (!lept_query_parse_name(&s, &t, *s))
+                    return 0;
+            }else{
+                if (!lept_query_parse_int(&s, &n) || n < 0)
+                    return 0;
+                t.key = NULL; t.klen = 0; t.hash = 0; t.index = (size_t)n;
+            }
+            if (*s++ != ']'){
+                free((char*)t.key);
+                return 0;
+            }
+        }else
+            break;
+        if (st->nrel == cap){
+            cap = cap ? cap * 2 : 4;
+            st->rel = (lept_token*)realloc(st->rel, cap * sizeof(lept_token));
+        }
+        st->rel[st->nrel++] = t;
+    }
+    lept_query_skip_ws(&s);
+    for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        if (strncmp(s, ops[i].s, strlen(ops[i].s)) == 0){
+            s += strlen(ops[i].s);
+            st->cmp = ops[i].cmp;
+            lept_query_skip_ws(&s);
+            if (!lept_query_parse_literal(&s, &st->literal))
+                return 0;
+            lept_query_skip_ws(&s);
+            break;
+        }
+    if (*s++ != ')')
+        return 0;
+    *p = s;
+    return 1;
+}
+
+/* [...] after '[' */
+static int lept_query_parse_bracket(const char** p, lept_query_step* st){
+    const char* s = *p;
+    lept_query_skip_ws(&s);
+    if (*s == '*'){
+        st->op = LEPT_QUERY_WILDCARD;
+        s++;
+    }else if (*s == '\'' || *s == '\"'){
+        st->op = LEPT_QUERY_CHILD;
+        if (!lept_query_parse_name(&s, &st->t, *s))
+            return 0;
+    }else if (*s == '?'){
+        s++;
+        if (!lept_query_parse_filter(&s, st))
+            return 0;
+    }else{
+        st->op = LEPT_QUERY_INDEX;
+        if (lept_query_parse_int(&s, &st->start))
+            st->flags |= LEPT_SLICE_HAS_START;
+        lept_query_skip_ws(&s);
+        if (*s == ':'){
+            st->op = LEPT_QUERY_SLICE;
+            st->step = 1;
+            s++;
+            lept_query_skip_ws(&s);
+            if (lept_query_parse_int(&s, &st->end))
+                st->flags |= LEPT_SLICE_HAS_END;
+            lept_query_skip_ws(&s);
+            if (*s == ':'){
+                s++;
+                lept_query_skip_ws(&s);
+                if (*s != ']' && !lept_query_parse_int(&s, &st->step))
+                    return 0;
+            }
+        }else if (!(st->flags & LEPT_SLICE_HAS_START))
+            return 0;
+    }
+    lept_query_skip_ws(&s);
+    if (*s++ != ']')
+        return 0;
+    *p = s;
+    return 1;
+}
+
+lept_query* lept_query_compile(const char* path){
+    lept_query* q;
+    const char* s = path;
+    size_t cap = 0;
+    assert(path != NULL);
+    if (*s++ != '$')
+        return NULL;
+    q = (lept_query*)malloc(sizeof(lept_query));
+    q->n = 0;
+    q->s = NULL;
+    while (*s){
+        lept_query_step* st;
+        int ok;
+        if (q->n == cap){
+            cap = cap ? cap * 2 : 4;
+            q->s = (lept_query_step*)realloc(q->s, cap * sizeof(lept_query_step));
+        }
+        st = &q->s[q->n++];
+        memset(st, 0, sizeof(lept_query_step));
+        lept_init(&st->literal);
+        if (s[0] == '.' && s[1] == '.'){
+            st->descend = 1;
+            s += 2;
+            if (*s == '[')
+                s++, ok = lept_query_parse_bracket(&s, st);
+            else if (*s == '*')
+                s++, st->op = LEPT_QUERY_WILDCARD, ok = 1;
+            else
+                st->op = LEPT_QUERY_CHILD, ok = lept_query_parse_name(&s, &st->t, 0);
+        }else if (*s == '.'){
+            s++;
+            if (*s == '*')
+                s++, st->op = LEPT_QUERY_WILDCARD, ok = 1;
+            else
+                st->op = LEPT_QUERY_CHILD, ok = lept_query_parse_name(&s, &st->t, 0);
+        }else if (*s == '['){
+            s++;
+            ok = lept_query_parse_bracket(&s, st);
+        }else
+            ok = 0;
+        if (!ok){
+            lept_query_free(q);
+            return NULL;
+        }
+    }
+    return q;
+}
+
+void lept_query_free(lept_query* q){
+    size_t i, j;
+    if (q == NULL)
+        return;
+    for (i = 0; i < q->n; i++){
+        lept_query_step* st = &q->s[i];
+        free((char*)st->t.key);
+        for (j = 0; j < st->nrel; j++)
+            free((char*)st->rel[j].key);
+        free(st->rel);
+        lept_free(&st->literal);
+    }
+    free(q->s);
+    free(q);
+}
+
+static void lept_query_push(lept_query_result* r, lept_value* v){
+    if (r->size == r->capacity){
+        r->capacity = r->capacity ? r->capacity + (r->capacity >> 1) : 16;
+        r->v = (lept_value**)realloc(r->v, r->capacity * sizeof(lept_value*));
+    }
+    r->v[r->size++] = v;
+}
+
+/* filter paths are typed: [n] only steps into arrays, .name and ['name'] only into objects */
+static const lept_value* lept_query_rel_step(const lept_value* v, const lept_token* t){
+    if ((t->key == NULL) != (v->type == LEPT_ARRAY))
+        return NULL;
+    return lept_pointer_step(v, t);
+}
+
+static int lept_query_test(const lept_query_step* st, const lept_value* v){
+    const lept_value* lit = &st->literal;
+    size_t i;
+    int r;
+    for (i = 0; i < st->nrel && v != NULL; i++)
+        v = lept_query_rel_step(v, &st->rel[i]);
+    if (v == NULL)
+        return 0;
+    switch (st->cmp){
+        case LEPT_CMP_EXISTS: return 1;
+        case LEPT_CMP_EQ: return lept_is_equal(v, lit);
+        case LEPT_CMP_NE: return !lept_is_equal(v, lit);
+        default: break;
+    }
+    // ordering is only defined between two numbers or two strings
+    if (v->type == LEPT_NUMBER && lit->type == LEPT_NUMBER)
+        r = (lept_get_number(v) > lept_get_number(lit)) - (lept_get_number(v) < lept_get_number(lit));
+    else if (v->type == LEPT_STRING && lit->type == LEPT_STRING){
+        size_t l1 = lept_get_string_length(v), l2 = lept_get_string_length(lit);
+        r = memcmp(lept_get_string(v), lept_get_string(lit), l1 < l2 ? l1 : l2);
+        if (r == 0)
+            r = (l1 > l2) - (l1 < l2);
+    }else
+        return 0;
+    switch (st->cmp){
+        case LEPT_CMP_LT: return r < 0;
+        case LEPT_CMP_LE: return r <= 0;
+        case LEPT_CMP_GT: return r > 0;
+        default:          return r >= 0;
+    }
+}
+
+static void lept_query_exec(const lept_query* q, size_t i, lept_value* v, lept_query_result* r);
+
+/* apply step i (without its descent) to v */
+static void lept_query_apply(const lept_query* q, size_t i, lept_value* v, lept_query_result* r){
+    const lept_query_step* st = &q->s[i];
+    size_t j, size = 0;
+    long len, lo, hi, k;
+    lept_value* child;
+    if (v->type == LEPT_ARRAY)
+        size = v->u.a.size;
+    else if (v->type == LEPT_OBJECT)
+        size = v->u.o.size;
+    else
+        return;
+    lept_hash_open(v);
+    switch (st->op){
+        case LEPT_QUERY_CHILD:
+            if (v->type == LEPT_OBJECT && (child = lept_pointer_step(v, &st->t)) != NULL)
+                lept_query_exec(q, i + 1, child, r);
+            break;
+        case LEPT_QUERY_INDEX:
+            if (v->type == LEPT_ARRAY){
+                k = st->start < 0 ? st->start + (long)size : st->start;
+                if (k >= 0 && k < (long)size)
+                    lept_query_exec(q, i + 1, &v->u.a.e[k], r);
+            }
+            break;
+        case LEPT_QUERY_WILDCARD:
+        case LEPT_QUERY_FILTER:
+            for (j = 0; j < size; j++){
+                child = v->type == LEPT_ARRAY ? &v->u.a.e[j] : &v->u.o.m[j].v;
+                if (st->op == LEPT_QUERY_WILDCARD || lept_query_test(st, child))
+                    lept_query_exec(q, i + 1, child, r);
+            }
+            break;
+        case LEPT_QUERY_SLICE:
+            if (v->type != LEPT_ARRAY || st->step == 0)
+                break;
+            len = (long)size;
+            // same normalization as Python / RFC 9535
+            if (st->step > 0){
+                lo = !(st->flags & LEPT_SLICE_HAS_START) ? 0 : st->start < 0 ? st->start + len : st->start;
+                hi = !(st->flags & LEPT_SLICE_HAS_END) ? len : st->end < 0 ? st->end + len : st->end;
+                lo = lo < 0 ? 0 : lo > len ? len : lo;
+                hi = hi < 0 ? 0 : hi > len ? len : hi;
+                for (k = lo; k < hi; k += st->step){
+                    lept_query_exec(q, i + 1, &v->u.a.e[k], r);
+                    if (st->step > hi - k)      // k + step would overflow past hi
+                        break;
+                }
+            }else{
+                hi = !(st->flags & LEPT_SLICE_HAS_START) ? len - 1 : st->start < 0 ? st->start + len : st->start;
+                lo = !(st->flags & LEPT_SLICE_HAS_END) ? -1 : st->end < 0 ? st->end + len : st->end;
+                lo = lo < -1 ? -1 : lo > len - 1 ? len - 1 : lo;
+                hi = hi < -1 ? -1 : hi > len - 1 ? len - 1 : hi;
+                for (k = hi; k > lo; k += st->step){
+                    lept_query_exec(q, i + 1, &v->u.a.e[k], r);
+                    if (st->step < lo - k)
+                        break;
+                }
+            }
+            break;
+    }
+}
+
+/* '..': apply to v and every descendant, in document order */
+static void lept_query_descend(const lept_query* q, size_t i, lept_value* v, lept_query_result* r){
+    size_t j;
+    lept_query_apply(q, i, v, r);
+    if (v->type == LEPT_ARRAY)
+        for (j = 0; j < v->u.a.size; j++)
+            lept_query_descend(q, i, &v->u.a.e[j], r);
+    else if (v->type == LEPT_OBJECT)
+        for (j = 0; j < v->u.o.size; j++)
+            lept_query_descend(q, i, &v->u.o.m[j].v, r);
+}
+
+static void lept_query_exec(const lept_query* q, size_t i, lept_value* v, lept_query_result* r){
+    if (i == q->n)
+        lept_query_push(r, v);
+    else if (q->s[i].descend)
+        lept_query_descend(q, i, v, r);
+    else
+        lept_query_apply(q, i, v, r);
+}
+
+/* r is reset, not freed, so a result can be reused across runs without allocations */
+size_t lept_query_run(const lept_value* doc, const lept_query* q, lept_query_result* r){
+    assert(doc != NULL && q != NULL && r != NULL);
+    r->size = 0;
+    lept_query_exec(q, 0, (lept_value*)doc, r);
+    return r->size;
+}
+
+void lept_query_result_free(lept_query_result* r){
+    assert(r != NULL);
+    free(r->v);
+    r->v = NULL;
+    r->size = r->capacity = 0;
+}
+
+/*
+ *  CBOR (RFC 8949)
+ *  numbers: integral values as major type 0/1, the rest as float32 if exact, else float64
+ */
+static void lept_cbor_put_head(lept_context* c, unsigned char major, unsigned long long n){
+    unsigned char* p;
+    int i, bytes;
+    major <<= 5;
+    if (n < 24){
+        PUTC(c, (char)(major | n));
+        return;
+    }
+    if (n <= 0xff)              { bytes = 1; major |= 24; }
+    else if (n <= 0xffff)       { bytes = 2; major |= 25; }
+    else if (n <= 0xffffffffULL){ bytes = 4; major |= 26; }
+    else                        { bytes = 8; major |= 27; }
+    p = (unsigned char*)lept_context_push(c, bytes + 1);
+    *p++ = major;
+    for (i = bytes - 1; i >= 0; i--, n >>= 8)
+        p[i] = (unsigned char)n;
+}
+
+static void lept_cbor_put_bits(lept_context* c, unsigned char ib, unsigned long long bits, int bytes){
+    unsigned char* p = (unsigned char*)lept_context_push(c, bytes + 1);
+    int i;
+    *p++ = ib;
+    for (i = bytes - 1; i >= 0; i--, bits >>= 8)
+        p[i] = (unsigned char)bits;
+}
+
+static void lept_cbor_put_number(lept_context* c, double n){
+    float f = (float)n;
+    if (n >= -18446744073709551616.0 && n < 18446744073709551616.0 && n == floor(n) && !(n == 0 && signbit(n))){
+        if (n >= 0)
+            lept_cbor_put_head(c, 0, (unsigned long long)n);
+        else if (n == -18446744073709551616.0)
+            lept_cbor_put_head(c, 1, 0xffffffffffffffffULL);
+        else    // -1 - m, in integers: -1.0 - n loses the 1 above 2^53
+            lept_cbor_put_head(c, 1, (unsigned long long)-n - 1);
+    }else if ((double)f == n || n != n){
+        unsigned int bits;
+        memcpy(&bits, &f, 4);
+        lept_cbor_put_bits(c, 0xfa, bits, 4);
+    }else{
+        unsigned long long bits;
+        memcpy(&bits, &n, 8);
+        lept_cbor_put_bits(c, 0xfb, bits, 8);
+    }
+}
+
+static void lept_cbor_encode_value(lept_context* c, const lept_value* v){
+    size_t i;
+    switch (v->type){
+        case LEPT_NULL:     PUTC(c, (char)0xf6); break;
+        case LEPT_FALSE:    PUTC(c, (char)0xf4); break;
+        case LEPT_TRUE:     PUTC(c, (char)0xf5); break;
+        case LEPT_NUMBER:   lept_cbor_put_number(c, lept_get_number(v)); break;
+        case LEPT_STRING:
+            lept_cbor_put_head(c, 3, lept_get_string_length(v));
+            if (lept_get_string_length(v) > 0)
+                PUTS(c, lept_get_string(v), lept_get_string_length(v));
+            break;
+        case LEPT_ARRAY:
+            lept_cbor_put_head(c, 4, v->u.a.size);
+            for (i = 0; i < v->u.a.size; i++)
+                lept_cbor_encode_value(c, &v->u.a.e[i]);
+            break;
+        case LEPT_OBJECT:
+            lept_cbor_put_head(c, 5, v->u.o.size);
+            for (i = 0; i < v->u.o.size; i++){
+                lept_cbor_put_head(c, 3, v->u.o.m[i].klen);
+                if (v->u.o.m[i].klen > 0)
+                    PUTS(c, v->u.o.m[i].k, v->u.o.m[i].klen);
+                lept_cbor_encode_value(c, &v->u.o.m[i].v);
+            }
+            break;
+        default: assert(0 && "invalid type");
+    }
+}
+
+unsigned char* lept_cbor_encode(const lept_value* v, size_t* length){
+    lept_context c;
+    assert(v != NULL);
+    c.stack = (char*)malloc(c.size = LEPT_PARSE_STRINGIFY_INIT_SIZE);
+    c.top = 0;
+    c.a = &lept_std_allocator;
+    LEPT_CONTEXT_STATS(&c, NULL);
+    lept_cbor_encode_value(&c, v);
+    if (length)
+        *length = c.top;
+    return (unsigned char*)c.stack;
+}
+
+typedef struct {
+    const unsigned char* p;
+    const unsigned char* end;
+}lept_cbor_reader;
+
+/* reads the argument of an item head, *major gets the major type */
+static int lept_cbor_get_head(lept_cbor_reader* r, int* major, int* info, unsigned long long* n){
+    int i, bytes;
+    if (r->p == r->end)
+        return LEPT_PARSE_INVALID_CBOR;
+    *major = *r->p >> 5;
+    *info = *r->p++ & 0x1f;
+    if (*info < 24){
+        *n = (unsigned long long)*info;
+        return LEPT_PARSE_OK;
+    }
+    if (*info > 27)     // indefinite lengths and reserved values
+        return LEPT_PARSE_INVALID_CBOR;
+    bytes = 1 << (*info - 24);
+    if (r->end - r->p < bytes)
+        return LEPT_PARSE_INVALID_CBOR;
+    for (*n = 0, i = 0; i < bytes; i++)
+        *n = (*n << 8) | *r->p++;
+    return LEPT_PARSE_OK;
+}
+
+static double lept_cbor_half(unsigned int h){
+    int exp = (h >> 10) & 0x1f;
+    double mant = h & 0x3ff, v;
+    if (exp == 0)
+        v = ldexp(mant, -24);
+    else if (exp != 31)
+        v = ldexp(mant + 1024, exp - 25);
+    else
+        v = mant == 0 ? HUGE_VAL : NAN;
+    return (h & 0x8000) ? -v : v;
+}
+
+static int lept_cbor_decode_value(lept_cbor_reader* r, lept_value* v, int depth);
+
+static int lept_cbor_get_string(lept_cbor_reader* r, const char** s, size_t* len){
+    unsigned long long n;
+    int major, info, ret;
+    if ((ret = lept_cbor_get_head(r, &major, &info, &n)) != LEPT_PARSE_OK)
+        return ret;
+    if ((major != 2 && major != 3) || n > (unsigned long long)(r->end - r->p))
+        return LEPT_PARSE_INVALID_CBOR;
+    *s = (const char*)r->p;
+    *len = (size_t)n;
+    r->p += n;
+    return LEPT_PARSE_OK;
+}
+
+static int lept_cbor_decode_value(lept_cbor_reader* r, lept_value* v, int depth){
+    unsigned long long n;
+    int major, info, ret;
+    size_t i, len;
+    const char* s;
+    const unsigned char* head = r->p;
+    if (depth > 1000)
+        return LEPT_PARSE_INVALID_CBOR;
+    if ((ret = lept_cbor_get_head(r, &major, &info, &n)) != LEPT_PARSE_OK)
+        return ret;
+    switch (major){
+        case 0: lept_set_number(v, (double)n); return LEPT_PARSE_OK;
+        case 1: lept_set_number(v, n == 0xffffffffffffffffULL ? -18446744073709551616.0 : -(double)(n + 1)); return LEPT_PARSE_OK;
+        case 2:
+        case 3:
+            r->p = head;
+            if ((ret = lept_cbor_get_string(r, &s, &len)) == LEPT_PARSE_OK)
+                lept_set_string(v, s, len);
+            return ret;
+        case 4:
+            // every item is at least one byte, don't trust larger counts
+            if (n > (unsigned long long)(r->end - r->p))
+                return LEPT_PARSE_INVALID_CBOR;
+            lept_set_array(v, (size_t)n);
+            for (i = 0; i < n; i++){
+                lept_init(&v->u.a.e[v->u.a.size]);
+                if ((ret = lept_cbor_decode_value(r, &v->u.a.e[v->u.a.size++], depth + 1)) != LEPT_PARSE_OK)
+                    return ret;
+            }
+            return LEPT_PARSE_OK;
+        case 5:
+            if (n > (unsigned long long)(r->end - r->p) / 2)
+                return LEPT_PARSE_INVALID_CBOR;
+            lept_set_object(v, (size_t)n);
+            for (i = 0; i < n; i++){
+                lept_member* m;
+                if ((ret = lept_cbor_get_string(r, &s, &len)) != LEPT_PARSE_OK)
+                    return ret;
+                // appended as-is like the parser does, duplicated keys included
+                m = &v->u.o.m[v->u.o.size++];
+                memcpy(m->k = lept_key_alloc(v, len), s, len);
+                m->k[len] = '\0';
+                m->klen = len;
+                lept_init(&m->v);
+                if ((ret = lept_cbor_decode_value(r, &m->v, depth + 1)) != LEPT_PARSE_OK)
+                    return ret;
+            }
+            return LEPT_PARSE_OK;
+        case 6:     // tag: decode the tagged item
+            return lept_cbor_decode_value(r, v, depth + 1);
+        default:
+            switch (info){
+                case 20: lept_set_boolean(v, 0); return LEPT_PARSE_OK;
+                case 21: lept_set_boolean(v, 1); return LEPT_PARSE_OK;
+                case 22:
+                case 23: lept_free(v); return LEPT_PARSE_OK;   // null, undefined
+                case 25: lept_set_number(v, lept_cbor_half((unsigned int)n)); return LEPT_PARSE_OK;
+                case 26: {
+                    unsigned int bits = (unsigned int)n;
+                    float f;
+                    memcpy(&f, &bits, 4);
+                    lept_set_number(v, f);
+                    return LEPT_PARSE_OK;
+                }
+                case 27: {
+                    double d;
+                    memcpy(&d, &n, 8);
+                    lept_set_number(v, d);
+                    return LEPT_PARSE_OK;
+                }
+                default: return LEPT_PARSE_INVALID_CBOR;
+            }
+    }
+}
+
+int lept_cbor_decode(lept_value* v, const unsigned char* data, size_t length){
+    lept_cbor_reader r;
+    int ret;
+    assert(v != NULL && (data != NULL || length == 0));
+    r.p = data;
+    r.end = data + length;
+    lept_init(v);
+    ret = lept_cbor_decode_value(&r, v, 0);
+    if (ret == LEPT_PARSE_OK && r.p != r.end)
+        ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    if (ret != LEPT_PARSE_OK)
+        lept_free(v);
+    return ret;
+}
+
+/*
+ *  snapshot
+ *  header, then nodes / member tables / strings, all 8-byte aligned
+ *  every offset is relative to the node or member that holds it, so a subtree can be read
+ *  without knowing where the file was mapped. object data is the member table in document
+ *  order followed by member indices sorted by key for binary search.
+ *  the file is trusted: only the header is checked on open, nodes are read as-is.
+ */
+#define LEPT_SNAPSHOT_MAGIC "LEPTSNAP"
+#define LEPT_SNAPSHOT_VERSION 1
+#define LEPT_SNAPSHOT_ENDIAN 0x01020304u
+
+struct lept_snode {
+    unsigned int type;
+    unsigned int n;     // string length, array size or object size
+    union {
+        double n;
+        long long off;  // from this node to its data
+    }u;
+};
+
+typedef struct {
+    long long k;        // from this member to its key
+    unsigned int klen, pad;
+    lept_snode v;
+}lept_smember;
+
+typedef struct {
+    char magic[8];
+    unsigned int version, endian;
+    unsigned long long size;
+    lept_snode root;
+}lept_snapshot_header;
+
+#define LEPT_SNODE_DATA(s) ((const char*)(s) + (s)->u.off)
+#define LEPT_SNODE_MEMBER(s, i) ((const lept_smember*)LEPT_SNODE_DATA(s) + (i))
+#define LEPT_SNODE_SORTED(s) ((const unsigned int*)LEPT_SNODE_MEMBER(s, (s)->n))
+
+typedef struct {
+    const char* k;
+    size_t klen;
+    unsigned int i;
+}lept_snapshot_key;
+
+static int lept_snapshot_key_compare(const void* lhs, const void* rhs){
+    const lept_snapshot_key* a = (const lept_snapshot_key*)lhs;
+    const lept_snapshot_key* b = (const lept_snapshot_key*)rhs;
+    int ret = memcmp(a->k, b->k, a->klen < b->klen ? a->klen : b->klen);
+    if (ret == 0)
+        ret = a->klen < b->klen ? -1 : a->klen > b->klen;
+    // duplicated keys keep document order, so lookups find the first one
+    return ret != 0 ? ret : (a->i > b->i) - (a->i < b->i);
+}
+
+/* zeroed, 8-byte aligned block on the stack, returns its offset */
+static size_t lept_snapshot_alloc(lept_context* c, size_t size){
+    size_t pos;
+    while (c->top & 7)
+        PUTC(c, 0);
+    pos = c->top;
+    if (size > 0)
+        memset(lept_context_push(c, size), 0, size);
+    return pos;
+}
+
+/* the stack may move on every alloc, nodes are addressed by offset */
+#define LEPT_SNAPSHOT_AT(c, type, pos) ((type*)((c)->stack + (pos)))
+
+static void lept_snapshot_put(lept_context* c, size_t pos, const lept_value* v){
+    size_t i, n, data;
+    lept_snode* s;
+    switch (v->type){
+        case LEPT_NUMBER:
+            LEPT_SNAPSHOT_AT(c, lept_snode, pos)->u.n = lept_get_number(v);
+            n = 0;
+            break;
+        case LEPT_STRING:
+            n = lept_get_string_length(v);
+            assert(n <= 0xffffffffu);
+            data = lept_snapshot_alloc(c, n + 1);
+            memcpy(c->stack + data, lept_get_string(v), n);
+            LEPT_SNAPSHOT_AT(c, lept_snode, pos)->u.off = (long long)(data - pos);
+            break;
+        case LEPT_ARRAY:
+            n = v->u.a.size;
+            assert(n <= 0xffffffffu);
+            data = lept_snapshot_alloc(c, n * sizeof(lept_snode));
+            LEPT_SNAPSHOT_AT(c, lept_snode, pos)->u.off = (long long)(data - pos);
+            for (i = 0; i < n; i++)
+                lept_snapshot_put(c, data + i * sizeof(lept_snode), &v->u.a.e[i]);
+            break;
+        case LEPT_OBJECT: {
+            lept_snapshot_key* keys;
+            n = v->u.o.size;
+            assert(n <= 0xffffffffu);
+            data = lept_snapshot_alloc(c, n * (sizeof(lept_smember) + sizeof(unsigned int)));
+            LEPT_SNAPSHOT_AT(c, lept_snode, pos)->u.off = (long long)(data - pos);
+            keys = (lept_snapshot_key*)malloc((n ? n : 1) * sizeof(lept_snapshot_key));
+            for (i = 0; i < n; i++){
+                size_t m = data + i * sizeof(lept_smember), k;
+                keys[i].k = v->u.o.m[i].k;
+                keys[i].klen = v->u.o.m[i].klen;
+                keys[i].i = (unsigned int)i;
+                k = lept_snapshot_alloc(c, keys[i].klen + 1);
+                memcpy(c->stack + k, keys[i].k, keys[i].klen);
+                LEPT_SNAPSHOT_AT(c, lept_smember, m)->k = (long long)(k - m);
+                LEPT_SNAPSHOT_AT(c, lept_smember, m)->klen = (unsigned int)keys[i].klen;
+                lept_snapshot_put(c, m + offsetof(lept_smember, v), &v->u.o.m[i].v);
+            }
+            qsort(keys, n, sizeof(lept_snapshot_key), lept_snapshot_key_compare);
+            for (i = 0; i < n; i++)
+                LEPT_SNAPSHOT_AT(c, unsigned int, data + n * sizeof(lept_smember))[i] = keys[i].i;
+            free(keys);
+            break;
+        }
+        default:
+            n = 0;
+            break;
+    }
+    s = LEPT_SNAPSHOT_AT(c, lept_snode, pos);
+    s->type = (unsigned int)v->type;
+    s->n = (unsigned int)n;
+}
+
+int lept_snapshot_write(const lept_value* v, const char* path){
+    lept_context c;
+    lept_snapshot_header* h;
+    FILE* fp;
+    int ret = -1;
+    assert(v != NULL && path != NULL);
+    c.stack = NULL;
+    c.size = c.top = 0;
+    c.a = &lept_std_allocator;
+    LEPT_CONTEXT_STATS(&c, NULL);
+    lept_snapshot_alloc(&c, sizeof(lept_snapshot_header));
+    lept_snapshot_put(&c, offsetof(lept_snapshot_header, root), v);
+    lept_snapshot_alloc(&c, 0);
+    h = LEPT_SNAPSHOT_AT(&c, lept_snapshot_header, 0);
+    memcpy(h->magic, LEPT_SNAPSHOT_MAGIC, 8);
+    h->version = LEPT_SNAPSHOT_VERSION;
+    h->endian = LEPT_SNAPSHOT_ENDIAN;
+    h->size = c.top;
+    if ((fp = fopen(path, "wb")) != NULL){
+        if (fwrite(c.stack, 1, c.top, fp) == c.top)
+            ret = 0;
+        if (fclose(fp) != 0)
+            ret = -1;
+    }
+    free(c.stack);
+    return ret;
+}
+
+int lept_snapshot_open(lept_snapshot* s, const char* path){
+    const lept_snapshot_header* h;
+    assert(s != NULL && path != NULL);
+    s->data = NULL;
+    s->size = 0;
+    s->mapped = 0;
+#ifdef LEPT_HAVE_MMAP
+    {
+        struct stat st;
+        void* p;
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return -1;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(lept_snapshot_header)){
+            close(fd);
+            return -1;
+        }
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return -1;
+        s->data = p;
+        s->size = (size_t)st.st_size;
+        s->mapped = 1;
+    }
+#else
+    {
+        FILE* fp = fopen(path, "rb");
+        long size;
+        void* p;
+        if (fp == NULL)
+            return -1;
+        if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < (long)sizeof(lept_snapshot_header)
+            || fseek(fp, 0, SEEK_SET) != 0 || (p = malloc((size_t)size)) == NULL){
+            fclose(fp);
+            return -1;
+        }
+        if (fread(p, 1, (size_t)size, fp) != (size_t)size){
+            free(p);
+            fclose(fp);
+            return -1;
+        }
+        fclose(fp);
+        s->data = p;
+        s->size = (size_t)size;
+    }
+#endif
+    h = (const lept_snapshot_header*)s->data;
+    if (memcmp(h->magic, LEPT_SNAPSHOT_MAGIC, 8) != 0 || h->version != LEPT_SNAPSHOT_VERSION
+        || h->endian != LEPT_SNAPSHOT_ENDIAN || h->size != s->size){
+        lept_snapshot_close(s);
+        return -1;
+    }
+    return 0;
 }
-const char* lept_get_string(const lept_value* v){
-    assert(v != NULL);
-    assert(v->type == LEPT_STRING);
-    return v->u.s.s;
+
+void lept_snapshot_close(lept_snapshot* s){
+    assert(s != NULL);
+#ifdef LEPT_HAVE_MMAP
+    if (s->mapped)
+        munmap((void*)s->data, s->size);
+    else
+#endif
+        free((void*)s->data);
+    s->data = NULL;
+    s->size = 0;
+    s->mapped = 0;
 }
-void lept_set_string(lept_value* v, const char* s, size_t len){
-    assert(v != NULL);
-    assert(s != NULL || len == 0);
-    lept_free(v);
-    v->u.s.s = (char*)malloc(len+1);
-    memcpy(v->u.s.s, s, len);
-    v->u.s.s[len] = '\0';
-    v->u.s.len = len;
-    v->type = LEPT_STRING;
+
+const lept_snode* lept_snapshot_root(const lept_snapshot* s){
+    assert(s != NULL && s->data != NULL);
+    return &((const lept_snapshot_header*)s->data)->root;
 }
 
-void lept_set_boolean(lept_value* v, int b){
-    // assert(v != NULL);
-    lept_free(v);
-    if (b == 0)
-        v->type = LEPT_FALSE;
-    else
-        v->type = LEPT_TRUE;
+lept_type lept_snode_get_type(const lept_snode* s){
+    assert(s != NULL);
+    return (lept_type)s->type;
 }
-int lept_get_boolean(const lept_value* v){
-    assert(v != NULL);
-    assert(v->type == LEPT_TRUE || v->type == LEPT_FALSE);
-    return v->type == LEPT_TRUE;
+
+int lept_snode_get_boolean(const lept_snode* s){
+    assert(s != NULL && (s->type == LEPT_TRUE || s->type == LEPT_FALSE));
+    return s->type == LEPT_TRUE;
 }
 
-size_t lept_get_array_size(const lept_value* v){
-    assert(v != NULL);
-    assert(v->type == LEPT_ARRAY);
-    return v->u.a.size;
+double lept_snode_get_number(const lept_snode* s){
+    assert(s != NULL && s->type == LEPT_NUMBER);
+    return s->u.n;
 }
 
-lept_value* lept_get_array_element(const lept_value* v, size_t index){
-    assert(v != NULL);
-    assert(v->type == LEPT_ARRAY);
-    assert(index < v->u.a.size);
-    return &v->u.a.e[index];
+const char* lept_snode_get_string(const lept_snode* s){
+    assert(s != NULL && s->type == LEPT_STRING);
+    return LEPT_SNODE_DATA(s);
 }
 
-size_t lept_get_object_size(const lept_value* v){
-    assert(v != NULL);
-    assert(v->type == LEPT_OBJECT);
-    return v->u.o.size;
+size_t lept_snode_get_string_length(const lept_snode* s){
+    assert(s != NULL && s->type == LEPT_STRING);
+    return s->n;
 }
-const char* lept_get_object_key(const lept_value* v, size_t index){
-    assert(v != NULL);
-    assert(v->type == LEPT_OBJECT);
-    assert(index < v->u.o.size);
-    return v->u.o.m[index].k;
+
+size_t lept_snode_get_array_size(const lept_snode* s){
+    assert(s != NULL && s->type == LEPT_ARRAY);
+    return s->n;
 }
-size_t lept_get_object_key_length(const lept_value* v, size_t index){
-    assert(v != NULL);
-    assert(v->type == LEPT_OBJECT);
-    assert(index < v->u.o.size);
-    return v->u.o.m[index].klen;
+
+const lept_snode* lept_snode_get_array_element(const lept_snode* s, size_t index){
+    assert(s != NULL && s->type == LEPT_ARRAY);
+    assert(index < s->n);
+    return (const lept_snode*)LEPT_SNODE_DATA(s) + index;
 }
-lept_value* lept_get_object_value(const lept_value* v, size_t index){
-    assert(v != NULL);
-    assert(v->type == LEPT_OBJECT);
-    assert(index < v->u.o.size);
-    return &(v->u.o.m[index].v);
+
+size_t lept_snode_get_object_size(const lept_snode* s){
+    assert(s != NULL && s->type == LEPT_OBJECT);
+    return s->n;
 }
-size_t lept_find_object_index(const lept_value* v,\
-                              const char* key,\
-                              size_t klen){
-    size_t i;
-    assert(v != NULL);
-    assert(v->type == LEPT_OBJECT);
-    assert(key != NULL);
-    for (i = 0; i < v->u.o.size; i++)
-        if (v->u.o.m[i].klen == klen && memcmp(v->u.o.m[i].k, key, klen) == 0)
-            return i;
+
+const char* lept_snode_get_object_key(const lept_snode* s, size_t index){
+    const lept_smember* m;
+    assert(s != NULL && s->type == LEPT_OBJECT);
+    assert(index < s->n);
+    m = LEPT_SNODE_MEMBER(s, index);
+    return (const char*)m + m->k;
+}
+
+size_t lept_snode_get_object_key_length(const lept_snode* s, size_t index){
+    assert(s != NULL && s->type == LEPT_OBJECT);
+    assert(index < s->n);
+    return LEPT_SNODE_MEMBER(s, index)->klen;
+}
+
+const lept_snode* lept_snode_get_object_value(const lept_snode* s, size_t index){
+    assert(s != NULL && s->type == LEPT_OBJECT);
+    assert(index < s->n);
+    return &LEPT_SNODE_MEMBER(s, index)->v;
+}
+
+size_t lept_snode_find_object_index(const lept_snode* s, const char* key, size_t klen){
+    const unsigned int* sorted;
+    size_t lo = 0, hi;
+    assert(s != NULL && s->type == LEPT_OBJECT && key != NULL);
+    sorted = LEPT_SNODE_SORTED(s);
+    hi = s->n;
+    // lower bound, the first of duplicated keys
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        const lept_smember* m = LEPT_SNODE_MEMBER(s, sorted[mid]);
+        int ret = memcmp((const char*)m + m->k, key, m->klen < klen ? m->klen : klen);
+        if (ret < 0 || (ret == 0 && m->klen < klen))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < s->n){
+        const lept_smember* m = LEPT_SNODE_MEMBER(s, sorted[lo]);
+        if (m->klen == klen && memcmp((const char*)m + m->k, key, klen) == 0)
+            return sorted[lo];
+    }
     return LEPT_KEY_NOT_EXIST;
 }
-lept_value* lept_find_object_value(lept_value* v,\
-                                   const char* key,\
-                                   size_t klen){
-    size_t index = lept_find_object_index(v, key, klen);
-    return index != LEPT_KEY_NOT_EXIST ? &v->u.o.m[index].v : NULL;
+
+const lept_snode* lept_snode_find_object_value(const lept_snode* s, const char* key, size_t klen){
+    size_t index = lept_snode_find_object_index(s, key, klen);
+    return index != LEPT_KEY_NOT_EXIST ? &LEPT_SNODE_MEMBER(s, index)->v : NULL;
 }
-lept_value* lept_set_object_value(lept_value* v,\
-                                  const char* key,\
-                                  size_t klen){
-    assert(v != NULL);
-    assert(v->type == LEPT_OBJECT);
-    assert(key != NULL);
-    // todo ...
-    size_t index = lept_find_object_index(v, key, klen);
-    
 
-    return NULL;
+/*
+ *  RFC 6902 JSON Patch
+ */
+
+#ifndef LEPT_DIFF_LCS_MAX
+#define LEPT_DIFF_LCS_MAX (1 << 20)     // LCS table cells, arrays with bigger changed middles are diffed by position
+#endif
+
+/* the context stack holds the JSON Pointer of the values being compared */
+static void lept_diff_push_key(lept_context* c, const char* k, size_t klen){
+    size_t i;
+    PUTC(c, '/');
+    for (i = 0; i < klen; i++){
+        if (k[i] == '~')
+            PUTS(c, "~0", 2);
+        else if (k[i] == '/')
+            PUTS(c, "~1", 2);
+        else
+            PUTC(c, k[i]);
+    }
 }
-void lept_remove_object_value(lept_value* v, size_t index){
-    assert(v != NULL);
-    assert(v->type == LEPT_OBJECT);
-    assert(index < v->u.o.size);
-    // todo ...
+
+static void lept_diff_push_index(lept_context* c, size_t index){
+    c->top -= 32 - sprintf(lept_context_push(c, 32), "/%lu", (unsigned long)index);
 }
 
+static void lept_diff_op(lept_context* c, lept_value* patch, const char* op, const lept_value* value){
+    lept_value* o = lept_pushback_array_element(patch);
+    lept_set_object(o, 3);
+    lept_set_string(lept_set_object_value(o, "op", 2), op, strlen(op));
+    lept_set_string(lept_set_object_value(o, "path", 4), c->stack, c->top);
+    if (value != NULL)
+        lept_copy(lept_set_object_value(o, "value", 5), value);
+}
 
+static void lept_diff_value(lept_context* c, lept_value* patch, const lept_value* a, const lept_value* b);
 
-static void lept_stringify_string(lept_context* c,\
-                                const char* s,\
-                                size_t len){
-    /* ... */
-    static const char hex_digits[] = { '0', '1', '2', '3', '4',\
-    '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-    size_t i, size;
-    char* buf, *head;
-    assert(s != NULL);
-    size = len * 6 + 2;
-    head = lept_context_push(c, size);
-    buf = head;
-    *buf++ = '\"';
-    for (i = 0; i < len; i++){
-        unsigned char ch = (unsigned char)s[i];
-        switch (ch){
-            case '\"':  *buf++ = '\\'; *buf++ = '\"'; break;
-            case '\\':  *buf++ = '\\'; *buf++ = '\\'; break;
-            case '\b':  *buf++ = '\\'; *buf++ = 'b'; break;
-            case '\f':  *buf++ = '\\'; *buf++ = 'f'; break;
-            case '\n':  *buf++ = '\\'; *buf++ = 'n'; break;
-            case '\r':  *buf++ = '\\'; *buf++ = 'r'; break;
-            case '\t':  *buf++ = '\\'; *buf++ = 't'; break;
-            default:
-                if (ch < 0x20){
-                    *buf++ = '\\'; *buf++ = 'u'; *buf++ = '0'; *buf++ = '0';
-                    *buf++ = hex_digits[ch >> 4];
-                    *buf++ = hex_digits[ch & 15];
-                }
-                else
-                    *buf++ = ch;
-                    // *buf++ = s[i];
-        }
+/* a[ai, ai + n) becomes b[bj, bj + m) at *pos: pairs are diffed in place, the rest removed or added */
+static void lept_diff_gap(lept_context* c, lept_value* patch, const lept_value* a, size_t ai, size_t n,
+                          const lept_value* b, size_t bj, size_t m, size_t* pos){
+    size_t i, top = c->top;
+    for (i = 0; i < n && i < m; i++){
+        lept_diff_push_index(c, (*pos)++);
+        lept_diff_value(c, patch, &a->u.a.e[ai + i], &b->u.a.e[bj + i]);
+        c->top = top;
+    }
+    for (i = n; i-- > m; ){   // last first, nothing has to shift
+        lept_diff_push_index(c, *pos + i - m);
+        lept_diff_op(c, patch, "remove", NULL);
+        c->top = top;
+    }
+    for (i = n; i < m; i++){
+        lept_diff_push_index(c, (*pos)++);
+        lept_diff_op(c, patch, "add", &b->u.a.e[bj + i]);
+        c->top = top;
     }
-    *buf++ = '\"';
-    c->top -= size - (buf - head);
 }
 
-static void lept_stringify_value(lept_context* c, const lept_value* v){
-    size_t i;
-    switch (v->type){
-        case LEPT_NULL:     PUTS(c, "null", 4); break;
-        case LEPT_FALSE:    PUTS(c, "false", 5); break;
-        case LEPT_TRUE:     PUTS(c, "true", 4); break;
-        case LEPT_NUMBER:
-            // char* buf = lept_context_push(c, 32);
-            // int len = sprintf(buf, "%.17g", v->u.n);
-            // c->top -= 32 - len;
-            c->top -= 32 - sprintf(lept_context_push(c, 32), "%.17g", v->u.n);
+/* common prefix and suffix are skipped, the middle is matched by LCS over element hashes */
+static void lept_diff_array(lept_context* c, lept_value* patch, const lept_value* a, const lept_value* b){
+    size_t na = a->u.a.size, nb = b->u.a.size, pre = 0, suf = 0, n, m, i, j, gi, gj, pos;
+    size_t *ha, *hb;
+    unsigned int* lcs;
+    while (pre < na && pre < nb && lept_is_equal(&a->u.a.e[pre], &b->u.a.e[pre]))
+        pre++;
+    while (suf < na - pre && suf < nb - pre && lept_is_equal(&a->u.a.e[na - 1 - suf], &b->u.a.e[nb - 1 - suf]))
+        suf++;
+    n = na - pre - suf;
+    m = nb - pre - suf;
+    pos = pre;
+    if (n == 0 || m == 0 || n + 1 > LEPT_DIFF_LCS_MAX / (m + 1)){
+        lept_diff_gap(c, patch, a, pre, n, b, pre, m, &pos);
+        return;
+    }
+    ha = (size_t*)malloc((n + m) * sizeof(size_t));
+    hb = ha + n;
+    for (i = 0; i < n; i++)
+        ha[i] = lept_hash(&a->u.a.e[pre + i]);
+    for (j = 0; j < m; j++)
+        hb[j] = lept_hash(&b->u.a.e[pre + j]);
+#define LEPT_DIFF_EQ(i, j) (ha[i] == hb[j] && lept_is_equal(&a->u.a.e[pre + (i)], &b->u.a.e[pre + (j)]))
+#define LEPT_DIFF_LCS(i, j) lcs[(i) * (m + 1) + (j)]
+    // LCS(i, j): longest common subsequence of a[i..] and b[j..]
+    lcs = (unsigned int*)calloc((n + 1) * (m + 1), sizeof(unsigned int));
+    for (i = n; i-- > 0; )
+        for (j = m; j-- > 0; )
+            if (LEPT_DIFF_EQ(i, j))
+                LEPT_DIFF_LCS(i, j) = LEPT_DIFF_LCS(i + 1, j + 1) + 1;
+            else if (LEPT_DIFF_LCS(i + 1, j) >= LEPT_DIFF_LCS(i, j + 1))
+                LEPT_DIFF_LCS(i, j) = LEPT_DIFF_LCS(i + 1, j);
+            else
+                LEPT_DIFF_LCS(i, j) = LEPT_DIFF_LCS(i, j + 1);
+    // unmatched runs between matches become gaps
+    i = j = gi = gj = 0;
+    while (i < n && j < m){
+        if (LEPT_DIFF_EQ(i, j)){
+            lept_diff_gap(c, patch, a, pre + gi, i - gi, b, pre + gj, j - gj, &pos);
+            pos++;
+            gi = ++i;
+            gj = ++j;
+        }else if (LEPT_DIFF_LCS(i + 1, j) >= LEPT_DIFF_LCS(i, j + 1))
+            i++;
+        else
+            j++;
+    }
+    lept_diff_gap(c, patch, a, pre + gi, n - gi, b, pre + gj, m - gj, &pos);
+#undef LEPT_DIFF_EQ
+#undef LEPT_DIFF_LCS
+    free(lcs);
+    free(ha);
+}
+
+static void lept_diff_value(lept_context* c, lept_value* patch, const lept_value* a, const lept_value* b){
+    size_t i, index, top = c->top;
+    if (a->type != b->type){
+        lept_diff_op(c, patch, "replace", b);
+        return;
+    }
+    // identical subtrees are skipped whole: hashes are cached per container, so this stays linear
+    if ((a->type == LEPT_OBJECT || a->type == LEPT_ARRAY) && lept_hash(a) == lept_hash(b) && lept_is_equal(a, b))
+        return;
+    switch (a->type){
+        case LEPT_OBJECT:
+            // members are matched through the key index (built once an object is big enough)
+            for (i = 0; i < a->u.o.size; i++){
+                const lept_member* m = &a->u.o.m[i];
+                lept_diff_push_key(c, m->k, m->klen);
+                if ((index = lept_find_object_index(b, m->k, m->klen)) == LEPT_KEY_NOT_EXIST)
+                    lept_diff_op(c, patch, "remove", NULL);
+                else
+                    lept_diff_value(c, patch, &m->v, &b->u.o.m[index].v);
+                c->top = top;
+            }
+            for (i = 0; i < b->u.o.size; i++){
+                const lept_member* m = &b->u.o.m[i];
+                if (lept_find_object_index(a, m->k, m->klen) == LEPT_KEY_NOT_EXIST){
+                    lept_diff_push_key(c, m->k, m->klen);
+                    lept_diff_op(c, patch, "add", &m->v);
+                    c->top = top;
+                }
+            }
             break;
-        case LEPT_STRING:   lept_stringify_string(c, v->u.s.s, v->u.s.len); break;
         case LEPT_ARRAY:
-            /* ... */
-            PUTC(c, '[');
-            for (i = 0; i < v->u.a.size; i++){
-                if (i > 0)
-                    PUTC(c, ',');
-                lept_stringify_value(c, &v->u.a.e[i]);
-            }
-            PUTC(c, ']');
+            lept_diff_array(c, patch, a, b);
             break;
-        case LEPT_OBJECT:
-            /* ... */
-            PUTC(c, '{');
-            for (i = 0; i < v->u.o.size; i++){
-                if (i > 0)
-                    PUTC(c, ',');
-                lept_stringify_string(c, v->u.o.m[i].k, v->u.o.m[i].klen);
-                PUTC(c, ':');
-                lept_stringify_value(c, &v->u.o.m[i].v);
-            }
-            PUTC(c, '}');
+        default:
+            if (!lept_is_equal(a, b))
+                lept_diff_op(c, patch, "replace", b);
             break;
-        default: assert(0 && "invalid type");
     }
 }
 
-char* lept_stringify(const lept_value* v, size_t* length){
+void lept_diff(lept_value* patch, const lept_value* from, const lept_value* to){
     lept_context c;
-    assert(v != NULL);
-    c.stack = (char*)malloc(c.size = LEPT_PARSE_STRINGIFY_INIT_SIZE);
-    c.top = 0;
-    lept_stringify_value(&c, v);
-    if (length)
-        *length = c.top;
-    PUTC(&c, '\0');
-    return c.stack;
+    assert(patch != NULL && from != NULL && to != NULL);
+    assert(patch != from && patch != to);
+    c.stack = NULL;
+    c.size = c.top = 0;
+    c.a = &lept_std_allocator;
+    LEPT_CONTEXT_STATS(&c, NULL);
+    lept_set_array(patch, 0);
+    lept_diff_value(&c, patch, from, to);
+    free(c.stack);
 }
 
-void lept_copy(lept_value* dst, const lept_value* src){
+/*
+ *  patches are applied in place: every change is logged with what it takes to undo it, and a
+ *  failing operation rolls the document back. values leaving the document move into the log.
+ */
+typedef enum { LEPT_UNDO_INSERTED, LEPT_UNDO_REMOVED, LEPT_UNDO_REPLACED } lept_undo_kind;
+
+typedef struct {
+    lept_undo_kind kind;
+    const lept_pointer* p;  // REPLACED: the value, otherwise p->n - 1 tokens lead to its container
+    size_t index;           // element/member index in the container
+    lept_member m;          // REMOVED: the member (m.k is NULL in arrays), REPLACED: m.v is the old value
+    const lept_allocator* a;    // m.k came from here
+    int carry;              // the value went on to/came from the next step of a move
+}lept_undo;
+
+typedef struct {
+    lept_undo* log;
+    size_t size, capacity;
+    lept_pointer** p;       // compiled paths, the log refers to them
+    size_t np, pcapacity;
+    lept_value carry;       // a moved value between its remove and add
+}lept_patcher;
+
+static lept_undo* lept_patch_log(lept_patcher* s, lept_undo_kind kind, const lept_pointer* p, size_t index){
+    lept_undo* u;
+    if (s->size == s->capacity)
+        s->log = (lept_undo*)realloc(s->log, (s->capacity = s->capacity ? s->capacity * 2 : 8) * sizeof(lept_undo));
+    u = &s->log[s->size++];
+    u->kind = kind;
+    u->p = p;
+    u->index = index;
+    u->m.k = NULL;
+    u->m.klen = 0;
+    u->a = NULL;
+    lept_init(&u->m.v);
+    u->carry = 0;
+    return u;
+}
+
+/* the string member key of op as a compiled pointer, NULL if missing or malformed */
+static const lept_pointer* lept_patch_pointer(lept_patcher* s, const lept_value* op, const char* key){
+    const lept_value* v = lept_find_object_value((lept_value*)op, key, strlen(key));
+    lept_pointer* p;
+    if (v == NULL || v->type != LEPT_STRING || (p = lept_pointer_compile(lept_get_string(v))) == NULL)
+        return NULL;
+    if (s->np == s->pcapacity)
+        s->p = (lept_pointer**)realloc(s->p, (s->pcapacity = s->pcapacity ? s->pcapacity * 2 : 8) * sizeof(lept_pointer*));
+    return s->p[s->np++] = p;
+}
+
+static lept_value* lept_patch_resolve(lept_value* doc, const lept_pointer* p, size_t n){
     size_t i;
-    assert(src != NULL);
-    assert(dst != NULL);
-    assert(src != NULL);
-    switch (src->type){
-        case LEPT_STRING:
-            lept_set_string(dst, src->u.s.s, src->u.s.len);
-            break;
-        case LEPT_ARRAY:
-            // todo
-            break;
-        case LEPT_OBJECT:
-            // todo
-            break;
-        default:
-            lept_free(dst);
-            memcpy(dst, src, sizeof(lept_value));
-            break;
+    for (i = 0; i < n && doc != NULL; i++)
+        doc = lept_pointer_step(doc, &p->t[i]);
+    if (doc != NULL)
+        lept_hash_open(doc);    // its members/elements get replaced in place
+    return doc;
+}
+
+static void lept_patch_replace(lept_patcher* s, const lept_pointer* p, lept_value* target, lept_value* value, int carry){
+    lept_undo* u = lept_patch_log(s, LEPT_UNDO_REPLACED, p, 0);
+    lept_move(&u->m.v, target);
+    lept_move(target, value);
+    u->carry = carry;
+}
+
+/* moves value into doc at p, carry: it is s->carry */
+static int lept_patch_add(lept_value* doc, lept_patcher* s, const lept_pointer* p, lept_value* value, int carry){
+    lept_value* parent;
+    const lept_token* t;
+    size_t index;
+    if (p->n == 0){
+        lept_patch_replace(s, p, doc, value, carry);
+        return LEPT_PARSE_OK;
+    }
+    if ((parent = lept_patch_resolve(doc, p, p->n - 1)) == NULL)
+        return LEPT_PARSE_PATCH_FAILED;
+    t = &p->t[p->n - 1];
+    if (parent->type == LEPT_OBJECT){
+        if ((index = lept_find_object_index(parent, t->key, t->klen)) != LEPT_KEY_NOT_EXIST){
+            lept_patch_replace(s, p, &parent->u.o.m[index].v, value, carry);
+            return LEPT_PARSE_OK;
+        }
+        lept_patch_log(s, LEPT_UNDO_INSERTED, p, parent->u.o.size)->carry = carry;
+        lept_move(lept_set_object_value(parent, t->key, t->klen), value);
+    }else if (parent->type == LEPT_ARRAY){
+        index = t->klen == 1 && t->key[0] == '-' ? parent->u.a.size : t->index;
+        if (index > parent->u.a.size)
+            return LEPT_PARSE_PATCH_FAILED;
+        lept_patch_log(s, LEPT_UNDO_INSERTED, p, index)->carry = carry;
+        lept_move(lept_insert_array_element(parent, index), value);
+    }else
+        return LEPT_PARSE_PATCH_FAILED;
+    return LEPT_PARSE_OK;
+}
+
+/* takes the value at p out of doc, into s->carry if carry is set */
+static int lept_patch_remove(lept_value* doc, lept_patcher* s, const lept_pointer* p, int carry){
+    lept_value* parent;
+    const lept_token* t;
+    lept_undo* u;
+    size_t index;
+    if (p->n == 0 || (parent = lept_patch_resolve(doc, p, p->n - 1)) == NULL)
+        return LEPT_PARSE_PATCH_FAILED;
+    t = &p->t[p->n - 1];
+    if (parent->type == LEPT_OBJECT){
+        if ((index = lept_find_object_index(parent, t->key, t->klen)) == LEPT_KEY_NOT_EXIST)
+            return LEPT_PARSE_PATCH_FAILED;
+        u = lept_patch_log(s, LEPT_UNDO_REMOVED, p, index);
+        u->a = LEPT_HEADER(parent->u.o.m)->a;
+        lept_take_object_member(parent, index, &u->m);
+    }else if (parent->type == LEPT_ARRAY && (index = t->index) < parent->u.a.size){
+        u = lept_patch_log(s, LEPT_UNDO_REMOVED, p, index);
+        lept_move(&u->m.v, &parent->u.a.e[index]);
+        lept_erase_array_element(parent, index, 1);
+    }else
+        return LEPT_PARSE_PATCH_FAILED;
+    if ((u->carry = carry) != 0)
+        lept_move(&s->carry, &u->m.v);
+    return LEPT_PARSE_OK;
+}
+
+static void lept_patch_undo(lept_value* doc, lept_patcher* s, lept_undo* u){
+    lept_value *v, *parent;
+    if (u->kind == LEPT_UNDO_REPLACED){
+        v = lept_patch_resolve(doc, u->p, u->p->n);
+        if (u->carry)
+            lept_move(&s->carry, v);
+        lept_move(v, &u->m.v);
+        return;
+    }
+    parent = lept_patch_resolve(doc, u->p, u->p->n - 1);
+    if (u->kind == LEPT_UNDO_INSERTED){
+        v = parent->type == LEPT_OBJECT ? &parent->u.o.m[u->index].v : &parent->u.a.e[u->index];
+        if (u->carry)
+            lept_move(&s->carry, v);
+        if (parent->type == LEPT_OBJECT)
+            lept_take_object_member(parent, u->index, NULL);
+        else
+            lept_erase_array_element(parent, u->index, 1);
+    }else{
+        if (u->carry)
+            lept_move(&u->m.v, &s->carry);
+        if (parent->type == LEPT_OBJECT)
+            lept_insert_object_member(parent, u->index, &u->m);
+        else
+            lept_move(lept_insert_array_element(parent, u->index), &u->m.v);
+        u->m.k = NULL;
+        lept_init(&u->m.v);
+    }
+}
+
+static int lept_patch_is(const lept_value* name, const char* op){
+    size_t len = strlen(op);
+    return lept_get_string_length(name) == len && memcmp(lept_get_string(name), op, len) == 0;
+}
+
+/* from is a proper prefix of path */
+static int lept_patch_is_child(const lept_pointer* from, const lept_pointer* path){
+    size_t i;
+    if (from->n >= path->n)
+        return 0;
+    for (i = 0; i < from->n; i++)
+        if (lept_token_compare(&from->t[i], &path->t[i]) != 0)
+            return 0;
+    return 1;
+}
+
+static int lept_patch_op(lept_value* doc, lept_patcher* s, const lept_value* op){
+    const lept_value *name, *value;
+    const lept_pointer *path, *from;
+    lept_value tmp, *target;
+    int ret;
+    if (op->type != LEPT_OBJECT)
+        return LEPT_PARSE_INVALID_PATCH;
+    name = lept_find_object_value((lept_value*)op, "op", 2);
+    value = lept_find_object_value((lept_value*)op, "value", 5);
+    if (name == NULL || name->type != LEPT_STRING || (path = lept_patch_pointer(s, op, "path")) == NULL)
+        return LEPT_PARSE_INVALID_PATCH;
+    if (lept_patch_is(name, "remove"))
+        return lept_patch_remove(doc, s, path, 0);
+    if (lept_patch_is(name, "move") || lept_patch_is(name, "copy")){
+        if ((from = lept_patch_pointer(s, op, "from")) == NULL)
+            return LEPT_PARSE_INVALID_PATCH;
+        if (lept_patch_is(name, "copy")){
+            if ((target = lept_patch_resolve(doc, from, from->n)) == NULL)
+                return LEPT_PARSE_PATCH_FAILED;
+            lept_init(&tmp);
+            lept_copy(&tmp, target);
+            ret = lept_patch_add(doc, s, path, &tmp, 0);
+            lept_free(&tmp);
+            return ret;
+        }
+        if (lept_patch_is_child(from, path))
+            return LEPT_PARSE_PATCH_FAILED;
+        if ((ret = lept_patch_remove(doc, s, from, 1)) != LEPT_PARSE_OK)
+            return ret;
+        return lept_patch_add(doc, s, path, &s->carry, 1);
+    }
+    if (value == NULL)
+        return LEPT_PARSE_INVALID_PATCH;
+    if (lept_patch_is(name, "test")){
+        target = lept_patch_resolve(doc, path, path->n);
+        return target != NULL && lept_is_equal(target, value) ? LEPT_PARSE_OK : LEPT_PARSE_PATCH_FAILED;
+    }
+    if (!lept_patch_is(name, "add") && !lept_patch_is(name, "replace"))
+        return LEPT_PARSE_INVALID_PATCH;
+    lept_init(&tmp);
+    lept_copy(&tmp, value);
+    if (lept_patch_is(name, "add"))
+        ret = lept_patch_add(doc, s, path, &tmp, 0);
+    else if ((target = lept_patch_resolve(doc, path, path->n)) != NULL){
+        lept_patch_replace(s, path, target, &tmp, 0);
+        ret = LEPT_PARSE_OK;
+    }else
+        ret = LEPT_PARSE_PATCH_FAILED;
+    lept_free(&tmp);
+    return ret;
+}
+
+int lept_patch_apply(lept_value* doc, const lept_value* patch){
+    lept_patcher s;
+    size_t i;
+    int ret = LEPT_PARSE_OK;
+    assert(doc != NULL && patch != NULL && doc != patch);
+    if (patch->type != LEPT_ARRAY)
+        return LEPT_PARSE_INVALID_PATCH;
+    memset(&s, 0, sizeof(s));
+    lept_init(&s.carry);
+    for (i = 0; i < patch->u.a.size && ret == LEPT_PARSE_OK; i++)
+        ret = lept_patch_op(doc, &s, &patch->u.a.e[i]);
+    // roll back on failure, then drop what the log still owns
+    for (i = s.size; i-- > 0; ){
+        if (ret != LEPT_PARSE_OK)
+            lept_patch_undo(doc, &s, &s.log[i]);
+        if (s.log[i].m.k != NULL)
+            s.log[i].a->free(s.log[i].a->ud, s.log[i].m.k);
+        lept_free(&s.log[i].m.v);
+    }
+    lept_free(&s.carry);
+    for (i = 0; i < s.np; i++)
+        lept_pointer_free(s.p[i]);
+    free(s.p);
+    free(s.log);
+    return ret;
+}
+
+void lept_merge_patch(lept_value* doc, const lept_value* patch){
+    size_t i, index;
+    assert(doc != NULL && patch != NULL && doc != patch);
+    if (patch->type != LEPT_OBJECT){
+        lept_copy(doc, patch);
+        return;
     }
-}
\ No newline at end of file
+    if (doc->type != LEPT_OBJECT)
+        lept_set_object(doc, patch->u.o.size);
+    for (i = 0; i < patch->u.o.size; i++){
+        const lept_member* m = &patch->u.o.m[i];
+        if (m->v.type != LEPT_NULL)
+            lept_merge_patch(lept_set_object_value(doc, m->k, m->klen), &m->v);
+        else if ((index = lept_find_object_index(doc, m->k, m->klen)) != LEPT_KEY_NOT_EXIST)
+            lept_remove_object_value(doc, index);
+    }
+}
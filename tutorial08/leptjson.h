@@ -1,24 +1,63 @@
 #ifndef LEPTJSON_H__
 #define LEPTJSON_H__
 #include <stdio.h>
+#include <stddef.h>
 
 typedef enum{ LEPT_NULL, LEPT_TRUE, LEPT_FALSE, LEPT_NUMBER, \
 			LEPT_STRING, LEPT_OBJECT, LEPT_ARRAY } lept_type;
 
 #define LEPT_KEY_NOT_EXIST ((size_t)-1)
 
+/*
+ *  define LEPT_COMPACT_VALUE to get a 16-byte lept_value on 64-bit targets:
+ *  sizes/lengths are 32-bit and the type is narrowed to one byte,
+ *  so the union and the type pack into two words (24 bytes otherwise).
+ */
+#ifdef LEPT_COMPACT_VALUE
+typedef unsigned int lept_size;
+typedef unsigned char lept_tag;
+#define LEPT_SIZE_MAX 0xffffffffu
+#else
+typedef size_t lept_size;
+typedef lept_type lept_tag;
+#define LEPT_SIZE_MAX ((size_t)-1)
+#endif
+
+/*
+ *  strings up to LEPT_SSO_CAPACITY bytes are stored inline in the union,
+ *  the last byte holds (LEPT_SSO_CAPACITY - len), so it doubles as '\0' when full
+ */
+#ifndef LEPT_SSO_CAPACITY
+#define LEPT_SSO_CAPACITY (sizeof(char*) + sizeof(lept_size) - 1)
+#endif
+#define LEPT_FLAG_INLINE_STRING 0x01
+/* a number parsed with lept_parse_options.lazy_numbers, not read yet: its source text, laid out like a short string */
+#define LEPT_FLAG_RAW_NUMBER 0x02
+
 typedef struct lept_value lept_value;
 typedef struct lept_member lept_member;
 
+#ifdef LEPT_COMPACT_VALUE
+#pragma pack(push, 4)		// no tail padding inside {pointer, 32-bit size}
+#endif
 struct lept_value{
 	union{
-		struct { lept_member* m; size_t size; }o;	// object
-		struct { lept_value* e; size_t size; }a; 	// array
-		struct { char *s; size_t len; }s;
+		struct { lept_member* m; lept_size size; }o;	// object
+		struct { lept_value* e; lept_size size; }a; 	// array
+		struct { char *s; lept_size len; }s;
+		char ss[LEPT_SSO_CAPACITY + 1];		// inline (short) string
 		double n;
 	}u;
-	lept_type type;
-};
+	lept_tag type;
+	unsigned char flags;	// LEPT_FLAG_*, lives in the padding after type
+}
+#if defined(LEPT_COMPACT_VALUE) && defined(__GNUC__)
+__attribute__((aligned(8)))		// keep pointers/doubles naturally aligned
+#endif
+;
+#ifdef LEPT_COMPACT_VALUE
+#pragma pack(pop)
+#endif
 
 struct lept_member{
 	char* k; size_t klen;	// member key string, key string length
@@ -39,13 +78,66 @@ enum{
 	LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
 	LEPT_PARSE_MISS_KEY,
 	LEPT_PARSE_MISS_COLON,
-	LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET
+	LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+	LEPT_PARSE_SCHEMA_MISMATCH,				// value doesn't fit the field descriptor
+	LEPT_PARSE_INVALID_CBOR,				// malformed or unsupported CBOR item
+	LEPT_PARSE_FILE_ERROR,					// file can't be opened or read
+	LEPT_PARSE_INVALID_PATCH,				// malformed patch operation
+	LEPT_PARSE_PATCH_FAILED,				// path not found or test operation failed
+	LEPT_PARSE_INVALID_UTF8,				// malformed UTF-8 in a string (lept_parse_options.strict_utf8)
+	LEPT_PARSE_NESTING_TOO_DEEP				// more than LEPT_VALIDATE_MAX_DEPTH open containers (lept_validate)
 };
 
 #define lept_init(v) do{ (v)->type = LEPT_NULL; } while(0)
 void lept_free(lept_value* v);
 #define lept_set_null(v) lept_free(v);
 
+/*
+ *  allocator for everything values own and for the parse stack. what a value owns remembers the
+ *  allocator it came from and goes back to it, so a tree parsed with lept_parse_options.allocator
+ *  is changed and freed like any other (lept_free_ex() is the same as lept_free() now), or its
+ *  memory is dropped as a whole. new parts come from the allocator current at the time.
+ *  buffers handed to the caller (lept_stringify, lept_cbor_encode, ...) always come from malloc().
+ */
+typedef struct {
+	void* (*alloc)(void* ud, size_t size);
+	void* (*realloc)(void* ud, void* p, size_t size);
+	void (*free)(void* ud, void* p);
+	void* ud;
+} lept_allocator;
+
+void lept_set_allocator(const lept_allocator* a);	// NULL restores malloc, a must outlive its values
+const lept_allocator* lept_get_allocator();
+void lept_free_ex(lept_value* v, const lept_allocator* a);
+
+/*
+ *  pool: bump allocator for parse-and-discard, free only gives back the latest block.
+ *  lept_pool_reset releases everything at once, keeping the largest chunk for reuse.
+ */
+typedef struct lept_pool lept_pool;
+lept_pool* lept_pool_create(size_t chunk_size);	// 0: default
+const lept_allocator* lept_pool_allocator(lept_pool* pool);
+void lept_pool_reset(lept_pool* pool);
+void lept_pool_destroy(lept_pool* pool);
+
+/*
+ *  slab: size classes for the small blocks values churn through (strings, keys, element and member
+ *  blocks), one pool for the process. each thread allocates from its own free lists and trades
+ *  blocks with the shared pool in batches. memory is kept for reuse, never returned to the system.
+ *  call lept_slab_flush before a thread that used it exits, or its cached blocks are lost.
+ */
+const lept_allocator* lept_slab_allocator();
+void lept_slab_flush();
+
+/*
+ *  opt-in: lept_parse/lept_stringify reuse up to two stacks of at most max_bytes each per thread
+ *  (0, the default, turns it off). the stacks come from the global allocator, a parse with its own
+ *  allocator doesn't use them. lept_thread_cleanup releases them, and the thread's slab cache:
+ *  call it before a global allocator that cached stacks goes away.
+ */
+void lept_set_context_cache(size_t max_bytes);
+void lept_thread_cleanup();
+
 int lept_get_boolean(const lept_value* v);
 void lept_set_boolean(lept_value* v, int b);
 
@@ -53,8 +145,58 @@ const char* lept_get_string(const lept_value* v);
 size_t lept_get_string_length(const lept_value* v);
 void lept_set_string(lept_value* v, const char* s, size_t len);
 
+typedef struct lept_fieldset lept_fieldset;
+
+/*
+ *  per-call counters, only filled when the library is built with LEPT_PARSE_STATS (otherwise
+ *  all of it compiles out). calls add to what's there, zero the struct to start over.
+ */
+typedef struct {
+	size_t input_bytes;				// consumed by lept_parse
+	size_t output_bytes;			// produced by lept_stringify
+	size_t values[LEPT_ARRAY + 1];	// parsed values by lept_type
+	size_t string_bytes;			// decoded string and key bytes
+	size_t escapes;					// escape sequences decoded
+	size_t mallocs, reallocs;
+	size_t stack_growths;			// lept_context stack reallocations
+	size_t stack_high;				// stack high-water mark in bytes
+	size_t max_depth;				// root value is depth 1
+	double parse_time, stringify_time;	// seconds
+} lept_parse_stats;
+
+/* zero-initialize, then set what's needed */
+typedef struct {
+	const lept_fieldset* fields;	// projection: materialize only these paths (NULL: everything),
+									// skipped values are checked like lept_validate() does
+	lept_parse_stats* stats;		// NULL: don't collect
+	const lept_allocator* allocator;	// NULL: the global one
+	int strict_utf8;				// reject strings that aren't well-formed UTF-8
+	int lazy_numbers;				// keep number text up to LEPT_SSO_CAPACITY bytes unconverted (see lept_get_number)
+} lept_parse_options;
+
+typedef struct {
+	lept_parse_stats* stats;		// NULL: don't collect
+	int canonical;					// RFC 8785: keys sorted, shortest numbers, for hashing/signing
+} lept_stringify_options;
+
 int lept_parse(lept_value *v, const char* json);
+int lept_parse_ex(lept_value* v, const char* json, const lept_parse_options* opt);
+int lept_parse_file(lept_value* v, const char* path);
+/*
+ *  well-formedness only: same grammar and error codes as lept_parse, but nothing is allocated,
+ *  decoded or converted. json needs no NUL terminator. on error *err_offset (if not NULL) is the
+ *  byte offset where it was detected.
+ */
+#ifndef LEPT_VALIDATE_MAX_DEPTH
+#define LEPT_VALIDATE_MAX_DEPTH 1024	// open containers, the state is one bit per level on the C stack
+#endif
+int lept_validate(const char* json, size_t len, size_t* err_offset);
+
+/* projection field set, paths in JSON Pointer syntax, "*" matches any member/element */
+lept_fieldset* lept_fieldset_compile(const char* const* pointers, size_t n);	// NULL if malformed
+void lept_fieldset_free(lept_fieldset* fs);
 char* lept_stringify(const lept_value* v, size_t* length);
+char* lept_stringify_ex(const lept_value* v, size_t* length, const lept_stringify_options* opt);
 
 void lept_copy(lept_value* dst, const lept_value* src);
 void lept_move(lept_value* dst, lept_value* src);
@@ -62,7 +204,18 @@ void lept_swap(lept_value* lhs, lept_value* rhs);
 
 lept_type lept_get_type(const lept_value* v);
 int lept_is_equal(const lept_value* lhs, const lept_value* rhs);
+/*
+ *  structural hash, equal values hash equal (object member order doesn't matter). arrays and objects
+ *  cache theirs, and lept_is_equal rejects on differing cached hashes. a container stops caching once
+ *  it's changed or a pointer into it is handed out (getters, pointers, queries), other trees keep theirs.
+ *  caching writes to the tree, see lept_build_index() for shared documents.
+ */
+size_t lept_hash(const lept_value* v);
 
+/*
+ *  a lazily parsed number is stringified as its source text until it's read or set: the first
+ *  lept_get_number (directly or through hash, compare, encode...) converts it in place.
+ */
 double lept_get_number(const lept_value* v);
 void lept_set_number(lept_value* v, double n);
 
@@ -75,6 +228,8 @@ void lept_shrink_array(lept_value* v);
 lept_value* lept_pushback_array_element(lept_value* v);
 void lept_popback_array_element(lept_value *v);
 lept_value* lept_insert_array_element(lept_value* v, size_t index);
+lept_value* lept_insert_array_elements(lept_value* v, size_t index, size_t count);
+lept_value* lept_append_array_elements(lept_value* v, size_t count);
 void lept_erase_array_element(lept_value* v, size_t index, size_t count);
 void lept_clear_array(lept_value* v);
 
@@ -91,6 +246,111 @@ void lept_shrink_object(lept_value* v);
 void lept_clear_object(lept_value* v);
 lept_value* lept_set_object_value(lept_value* v, const char* key, size_t klen);
 void lept_remove_object_value(lept_value* v, size_t index);
+void lept_swap_remove_object_value(lept_value* v, size_t index);
+
+/*
+ *  reads aren't free of writes: big objects build their key index on the first lookup, getters
+ *  mark containers for lept_hash(), and lazily parsed numbers are converted when first read.
+ *  call this once on a document before reading it from several threads, after that getters,
+ *  lookups, pointers, queries and lept_hash() only read it. any change needs exclusive access again.
+ */
+void lept_build_index(lept_value* v);
+
+/* RFC 6901 JSON Pointer, compile once and reuse */
+typedef struct lept_pointer lept_pointer;
+typedef struct lept_pointer_batch lept_pointer_batch;
+lept_pointer* lept_pointer_compile(const char* pointer);	// NULL if malformed
+void lept_pointer_free(lept_pointer* p);
+lept_value* lept_pointer_get(const lept_value* doc, const lept_pointer* p);	// NULL if not found
+lept_pointer_batch* lept_pointer_batch_compile(const char* const* pointers, size_t n);
+void lept_pointer_batch_free(lept_pointer_batch* b);
+void lept_pointer_batch_get(const lept_value* doc, const lept_pointer_batch* b, lept_value** out);
+
+/* JSONPath subset: $ .name ['name'] [n] [start:end:step] * .. [?(@.rel op literal)] */
+typedef struct lept_query lept_query;
+typedef struct { lept_value** v; size_t size, capacity; } lept_query_result;	// zero-initialize before first use
+lept_query* lept_query_compile(const char* path);	// NULL if malformed
+void lept_query_free(lept_query* q);
+size_t lept_query_run(const lept_value* doc, const lept_query* q, lept_query_result* r);
+void lept_query_result_free(lept_query_result* r);
+
+/* RFC 6902 JSON Patch */
+void lept_diff(lept_value* patch, const lept_value* from, const lept_value* to);	// patch: array of operations turning from into to
+int lept_patch_apply(lept_value* doc, const lept_value* patch);		// all or nothing, doc is unchanged on error
+/* RFC 7396 JSON Merge Patch */
+void lept_merge_patch(lept_value* doc, const lept_value* patch);
+
+/*
+ *  descriptor-driven parsing straight into C structs (no lept_value tree),
+ *  a table ends with LEPT_FIELD_END, eg.
+ *      static const lept_field_desc user_desc[] = {
+ *          LEPT_FIELD("id", struct user, id, LEPT_FIELD_INT),
+ *          LEPT_FIELD_NESTED("meta", struct user, meta, meta_desc),
+ *          LEPT_FIELD_END
+ *      };
+ */
+typedef enum {
+	LEPT_FIELD_BOOL,	// int
+	LEPT_FIELD_INT,		// int
+	LEPT_FIELD_INT64,	// long long
+	LEPT_FIELD_DOUBLE,	// double
+	LEPT_FIELD_STRING,	// char*, malloc'd
+	LEPT_FIELD_CHARS,	// char[size], '\0' terminated
+	LEPT_FIELD_STRUCT,	// nested struct described by nested
+	LEPT_FIELD_VALUE	// lept_value, anything goes
+} lept_field_type;
+
+typedef struct lept_field_desc lept_field_desc;
+struct lept_field_desc {
+	const char* key;
+	size_t offset;
+	lept_field_type type;
+	size_t size;					// sizeof the member
+	const lept_field_desc* nested;	// LEPT_FIELD_STRUCT
+};
+
+#define LEPT_FIELD(key, st, member, type) { key, offsetof(st, member), type, sizeof(((st*)0)->member), NULL }
+#define LEPT_FIELD_NESTED(key, st, member, desc) { key, offsetof(st, member), LEPT_FIELD_STRUCT, sizeof(((st*)0)->member), desc }
+#define LEPT_FIELD_END { NULL, 0, LEPT_FIELD_BOOL, 0, NULL }
+
+typedef struct lept_schema lept_schema;
+lept_schema* lept_schema_compile(const lept_field_desc* fields);
+void lept_schema_free(lept_schema* s);
+/* out must be zero-initialized, absent/null members are left untouched, unknown keys skipped */
+int lept_parse_struct(void* out, const char* json, const lept_schema* s);
+void lept_free_struct(void* out, const lept_schema* s);
+char* lept_stringify_struct(const void* in, const lept_schema* s, size_t* length);	// NULL char* fields become null
+
+/* CBOR (RFC 8949) binary encoding, definite lengths only */
+unsigned char* lept_cbor_encode(const lept_value* v, size_t* length);
+int lept_cbor_decode(lept_value* v, const unsigned char* data, size_t length);
+
+/* read-only snapshot, relative offsets so a file can be mmap'ed and read in place */
+typedef struct lept_snode lept_snode;
+typedef struct {
+	const void* data;
+	size_t size;
+	int mapped;
+}lept_snapshot;
+
+int lept_snapshot_write(const lept_value* v, const char* path);
+int lept_snapshot_open(lept_snapshot* s, const char* path);
+void lept_snapshot_close(lept_snapshot* s);
+const lept_snode* lept_snapshot_root(const lept_snapshot* s);
+
+lept_type lept_snode_get_type(const lept_snode* s);
+int lept_snode_get_boolean(const lept_snode* s);
+double lept_snode_get_number(const lept_snode* s);
+const char* lept_snode_get_string(const lept_snode* s);
+size_t lept_snode_get_string_length(const lept_snode* s);
+size_t lept_snode_get_array_size(const lept_snode* s);
+const lept_snode* lept_snode_get_array_element(const lept_snode* s, size_t index);
+size_t lept_snode_get_object_size(const lept_snode* s);
+const char* lept_snode_get_object_key(const lept_snode* s, size_t index);
+size_t lept_snode_get_object_key_length(const lept_snode* s, size_t index);
+const lept_snode* lept_snode_get_object_value(const lept_snode* s, size_t index);
+size_t lept_snode_find_object_index(const lept_snode* s, const char* key, size_t klen);
+const lept_snode* lept_snode_find_object_value(const lept_snode* s, const char* key, size_t klen);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -69,6 +69,7 @@ static void test_parse_false(){
         EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
         EXPECT_EQ_INT(LEPT_NUMBER, lept_get_type(&v));\
         EXPECT_EQ_DOUBLE(expect, lept_get_number(&v));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_validate(json, strlen(json), NULL));\
         lept_free(&v);\
     } while(0)
 
@@ -235,6 +236,7 @@ static void test_parse_object(){
         v.type = LEPT_TRUE;\
         EXPECT_EQ_INT(error, lept_parse(&v, json));\
         EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));\
+        EXPECT_EQ_INT(error, lept_validate(json, strlen(json), NULL));\
     } while(0)
 
 static void test_parse_expect_value(){
@@ -315,6 +317,174 @@ static void test_parse_invalid_unicode_surrogate() {
     TEST_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE, "\"\\uD800\\uE000\"");
 }
 
+#define TEST_UTF8(expect, json)\
+    do {\
+        lept_value v;\
+        lept_parse_options opt = { 0 };\
+        opt.strict_utf8 = 1;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
+        lept_free(&v);\
+        EXPECT_EQ_INT(expect, lept_parse_ex(&v, json, &opt));\
+        if (expect == LEPT_PARSE_OK)\
+            lept_free(&v);\
+        else\
+            EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));\
+    } while(0)
+
+static void test_parse_invalid_utf8() {
+    lept_parse_options opt = { 0 };
+    lept_fieldset* fs;
+    lept_value v;
+    static const char* paths[] = { "/a" };
+    TEST_UTF8(LEPT_PARSE_OK, "\"\xc2\x80\xdf\xbf\xe0\xa0\x80\xed\x9f\xbf\xee\x80\x80\xef\xbf\xbf\"");
+    TEST_UTF8(LEPT_PARSE_OK, "\"\xf0\x90\x80\x80\xf3\xbf\xbf\xbf\xf4\x8f\xbf\xbf\"");
+    TEST_UTF8(LEPT_PARSE_OK, "{\"\xe2\x82\xac\":\"0123456789abcdef\\n\xf0\x9f\x98\x80\"}");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\x80\"");                   /* continuation without lead */
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xc0\xaf\"");               /* overlong */
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xc1\xbf\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xe0\x9f\xbf\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xf0\x8f\xbf\xbf\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xed\xa0\x80\"");           /* surrogate */
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xf4\x90\x80\x80\"");       /* above U+10FFFF */
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xf5\x80\x80\x80\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xff\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xe2\x82\"");               /* truncated */
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xe2\x82\x41\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"0123456789abcdef0123456789\xa9\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "[\"a\",{\"\xc3\":1}]");
+
+    /* strings skipped by a projection are checked too */
+    fs = lept_fieldset_compile(paths, 1);
+    opt.fields = fs;
+    opt.strict_utf8 = 1;
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, "{\"a\":1,\"b\":[\"\xe2\x82\xac\"]}", &opt));
+    lept_free(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_UTF8, lept_parse_ex(&v, "{\"a\":1,\"b\":[\"\xe2\x82\"]}", &opt));
+    lept_fieldset_free(fs);
+}
+
+/* lazy numbers stringify as their source text, and compare/hash like converted ones */
+#define TEST_LAZY(expect, json)\
+    do {\
+        lept_value v, w;\
+        lept_parse_options opt = { 0 };\
+        char* json2;\
+        size_t length;\
+        opt.lazy_numbers = 1;\
+        lept_init(&v);\
+        lept_init(&w);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, json, &opt));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&w, json));\
+        json2 = lept_stringify(&v, &length);\
+        EXPECT_EQ_STRING(expect, json2, length);\
+        EXPECT_TRUE(lept_is_equal(&v, &w));\
+        EXPECT_EQ_SIZE_T(lept_hash(&w), lept_hash(&v));\
+        free(json2);\
+        lept_free(&v);\
+        lept_free(&w);\
+    } while(0)
+
+static void test_parse_lazy_numbers() {
+    lept_parse_options opt = { 0 };
+    lept_value v, w;
+    char* json;
+    size_t length;
+
+    TEST_LAZY("[1.0,-0,1E+2,0.10000,1e-400,-12345678.9]", "[1.0,-0,1E+2,0.10000,1e-400,-12345678.9]");
+    TEST_LAZY("{\"a\":[0.5,2e1],\"b\":{\"c\":100}}", "{ \"a\" : [ 0.5 , 2e1 ] , \"b\" : { \"c\" : 100 } }");
+    /* too long to keep: converted while parsing */
+    TEST_LAZY("3.1415926535897931", "3.14159265358979323846264");
+
+    opt.lazy_numbers = 1;
+    lept_init(&v);
+    lept_init(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_NUMBER_TOO_BIG, lept_parse_ex(&v, "1e309", &opt));
+    EXPECT_EQ_INT(LEPT_PARSE_NUMBER_TOO_BIG, lept_parse_ex(&v, "[-18e307]", &opt));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, lept_parse_ex(&v, "[1.]", &opt));
+
+    /* the first read converts in place, the text is gone after it */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, "[1.50,7,2.50]", &opt));
+    lept_copy(&w, &v);
+    EXPECT_EQ_DOUBLE(1.5, lept_get_number(lept_get_array_element(&v, 0)));
+    EXPECT_EQ_DOUBLE(1.5, lept_get_number(lept_get_array_element(&v, 0)));
+    lept_set_number(lept_get_array_element(&v, 1), 8.0);
+    json = lept_stringify(&v, &length);
+    EXPECT_EQ_STRING("[1.5,8,2.50]", json, length);
+    free(json);
+    json = lept_stringify(&w, &length);
+    EXPECT_EQ_STRING("[1.50,7,2.50]", json, length);
+    free(json);
+    lept_free(&v);
+    lept_free(&w);
+}
+
+#define TEST_VALIDATE(error, offset, json)\
+    do {\
+        size_t err_offset = (size_t)-1;\
+        EXPECT_EQ_INT(error, lept_validate(json, sizeof(json) - 1, &err_offset));\
+        if (error != LEPT_PARSE_OK)\
+            EXPECT_EQ_SIZE_T(offset, err_offset);\
+    } while(0)
+
+static void test_validate() {
+    char deep[LEPT_VALIDATE_MAX_DEPTH + 2];
+    const char* json = "{\"a\":[1,2.5e3,-0.25,true,false,null],\"b\":{\"c\":\"\\u00e9\\uD834\\uDD1E x\"}} trailing";
+    size_t i, err_offset;
+
+    TEST_VALIDATE(LEPT_PARSE_OK, 0, " [ 1 , { \"k\" : [ ] , \"l\" : { } } , \"0123456789abcdef\\n\" ] ");
+    TEST_VALIDATE(LEPT_PARSE_OK, 0, "\"\xe2\x82\xac 0123456789abcdef0123456789\"");
+    TEST_VALIDATE(LEPT_PARSE_INVALID_VALUE, 5, "[1,2,]");
+    TEST_VALIDATE(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, 2, "[01]");
+    TEST_VALIDATE(LEPT_PARSE_INVALID_VALUE, 3, "nul");
+    TEST_VALIDATE(LEPT_PARSE_INVALID_STRING_CHAR, 20, "\"0123456789abcdefghi\x01\"");
+    TEST_VALIDATE(LEPT_PARSE_INVALID_STRING_ESCAPE, 17, "[\"0123456789abcd\\x\"]");
+    TEST_VALIDATE(LEPT_PARSE_MISS_QUOTATION_MARK, 12, "{\"a\":\"abcdef");
+    TEST_VALIDATE(LEPT_PARSE_MISS_COLON, 5, "{\"a\" 1}");
+    TEST_VALIDATE(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, 6, "{\"a\":1]");
+    TEST_VALIDATE(LEPT_PARSE_ROOT_NOT_SINGULAR, 3, "{} x");
+    TEST_VALIDATE(LEPT_PARSE_EXPECT_VALUE, 7, "[[1], [");
+    /* NUL is a byte like any other: the length decides where the input ends */
+    TEST_VALIDATE(LEPT_PARSE_INVALID_STRING_CHAR, 2, "\"a\0\"");
+    TEST_VALIDATE(LEPT_PARSE_ROOT_NOT_SINGULAR, 4, "true\0");
+
+    /* the input needs no terminator */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_validate(json, strlen(json) - 9, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, lept_validate(json, strlen(json) - 10, &err_offset));
+    EXPECT_EQ_SIZE_T(strlen(json) - 10, err_offset);
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_validate(json, 7, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_validate(json, 8, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, lept_validate(json, 10, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_UNICODE_HEX, lept_validate(json, 51, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_UNICODE_SURROGATE, lept_validate(json, 59, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_validate(json, 0, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_validate("10", 1, NULL));
+
+    /* overflow is decided without converting the number */
+    TEST_VALIDATE(LEPT_PARSE_OK, 0, "1.7976931348623157e308");
+    TEST_VALIDATE(LEPT_PARSE_OK, 0, "-179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497791");
+    TEST_VALIDATE(LEPT_PARSE_NUMBER_TOO_BIG, 0, "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497792");
+    TEST_VALIDATE(LEPT_PARSE_OK, 0, "0.00017976931348623158e312");
+    TEST_VALIDATE(LEPT_PARSE_NUMBER_TOO_BIG, 1, "[0.00017976931348623159e312]");
+    TEST_VALIDATE(LEPT_PARSE_OK, 0, "100000e-100000000000000000000000000000");
+    TEST_VALIDATE(LEPT_PARSE_OK, 0, "0e100000000000000000000000000000");
+    TEST_VALIDATE(LEPT_PARSE_NUMBER_TOO_BIG, 0, "1e100000000000000000000000000000");
+    /* an exponent that would wrap a size_t to a small one */
+    TEST_VALIDATE(LEPT_PARSE_NUMBER_TOO_BIG, 0, "1e18446744073709551620");
+    TEST_VALIDATE(LEPT_PARSE_NUMBER_TOO_BIG, 1, "[1e18446744073709551620]");
+
+    /* nesting is bounded */
+    memset(deep, '[', sizeof(deep));
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_validate(deep, LEPT_VALIDATE_MAX_DEPTH, NULL));
+    EXPECT_EQ_INT(LEPT_PARSE_NESTING_TOO_DEEP, lept_validate(deep, LEPT_VALIDATE_MAX_DEPTH + 1, &err_offset));
+    EXPECT_EQ_SIZE_T(LEPT_VALIDATE_MAX_DEPTH, err_offset);
+    for (i = 0; i < 64; i++)
+        deep[i] = i % 2 ? '[' : '{';
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_KEY, lept_validate(deep, 64, &err_offset));
+    EXPECT_EQ_SIZE_T(1, err_offset);
+}
+
 static void test_parse_miss_comma_or_square_bracket(){
     TEST_ERROR(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1");
     TEST_ERROR(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1)");
@@ -345,6 +515,92 @@ static void test_parse_miss_comma_or_curly_braceket(){
     TEST_ERROR(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+static void test_parse_projection();
+static void test_parse_struct();
+
+static void write_file(const char* path, const char* s, size_t len) {
+    FILE* fp = fopen(path, "wb");
+    fwrite(s, 1, len, fp);
+    fclose(fp);
+}
+
+static void test_parse_file() {
+    const char* path = "test_parse_file.tmp";
+    static const size_t sizes[] = { 4096, 16384, 65536 };
+    lept_value v;
+    char* s;
+    size_t i;
+
+    write_file(path, " {\"a\":[1,2,{\"b\":null}]} ", 25);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_file(&v, path));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(&v));
+    EXPECT_EQ_SIZE_T(3, lept_get_array_size(lept_find_object_value(&v, "a", 1)));
+    lept_free(&v);
+
+    /* file ends exactly on a page boundary, nothing mapped after it but the reserved page */
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        s = (char*)malloc(sizes[i]);
+        memset(s, 'a', sizes[i]);
+        s[0] = s[sizes[i] - 1] = '"';
+        write_file(path, s, sizes[i]);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_file(&v, path));
+        EXPECT_EQ_SIZE_T(sizes[i] - 2, lept_get_string_length(&v));
+        lept_free(&v);
+        s[sizes[i] - 1] = 'a';
+        write_file(path, s, sizes[i]);
+        EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, lept_parse_file(&v, path));
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+        free(s);
+    }
+
+    write_file(path, "", 0);
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_parse_file(&v, path));
+    write_file(path, "[1,2] x", 7);
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, lept_parse_file(&v, path));
+    remove(path);
+    EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, lept_parse_file(&v, path));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+}
+
+static void test_parse_stats() {
+    static const lept_parse_stats zero = { 0 };
+    const char* json = " {\"a\":[1,true,null],\"long key, not inline\":\"x\\ny\\u00e9\",\"s\":\"\"} ";
+    lept_parse_options opt = { 0 };
+    lept_stringify_options sopt = { 0 };
+    lept_parse_stats stats = { 0 };
+    lept_value v;
+    char* json2;
+    size_t length;
+    opt.stats = &stats;
+    sopt.stats = &stats;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, json, &opt));
+    json2 = lept_stringify_ex(&v, &length, &sopt);
+#ifdef LEPT_PARSE_STATS
+    EXPECT_EQ_SIZE_T(strlen(json), stats.input_bytes);
+    EXPECT_EQ_SIZE_T(length, stats.output_bytes);
+    EXPECT_EQ_SIZE_T(1, stats.values[LEPT_OBJECT]);
+    EXPECT_EQ_SIZE_T(1, stats.values[LEPT_ARRAY]);
+    EXPECT_EQ_SIZE_T(1, stats.values[LEPT_NUMBER]);
+    EXPECT_EQ_SIZE_T(1, stats.values[LEPT_TRUE]);
+    EXPECT_EQ_SIZE_T(1, stats.values[LEPT_NULL]);
+    EXPECT_EQ_SIZE_T(2, stats.values[LEPT_STRING]);
+    EXPECT_EQ_SIZE_T(0, stats.values[LEPT_FALSE]);
+    EXPECT_EQ_SIZE_T(2, stats.escapes);
+    EXPECT_EQ_SIZE_T(1 + 20 + 5 + 1, stats.string_bytes);
+    EXPECT_EQ_SIZE_T(3, stats.max_depth);
+    EXPECT_EQ_SIZE_T(1, stats.stack_growths);  // the parse stack starts empty
+    EXPECT_TRUE(stats.stack_high >= 3 * sizeof(lept_member));
+    /* keys 3, array 1, object 1, parse stack 1, stringify buffer 1; short strings are inline */
+    EXPECT_EQ_SIZE_T(7, stats.mallocs);
+    EXPECT_TRUE(stats.parse_time >= 0 && stats.stringify_time >= 0);
+#else
+    EXPECT_TRUE(memcmp(&zero, &stats, sizeof(stats)) == 0);
+#endif
+    (void)zero;
+    lept_free(&v);
+    free(json2);
+}
+
 static void test_parse(){
     test_parse_null();
     test_parse_true();
@@ -363,10 +619,17 @@ static void test_parse(){
     test_parse_missing_quotation_mark();
     test_parse_invalid_unicode_hex();
     test_parse_invalid_unicode_surrogate();
+    test_parse_invalid_utf8();
+    test_validate();
+    test_parse_lazy_numbers();
     test_parse_miss_comma_or_square_bracket();
     test_parse_miss_key();
     test_parse_miss_colon();
     test_parse_miss_comma_or_curly_braceket();
+    test_parse_projection();
+    test_parse_struct();
+    test_parse_file();
+    test_parse_stats();
 }
 
 #define TEST_ROUNDTRIP(json)\
@@ -382,6 +645,21 @@ static void test_parse(){
         free(json2);\
     } while(0)
 
+#define TEST_CANONICAL(expect, json)\
+    do {\
+        lept_value v;\
+        lept_stringify_options opt = { 0 };\
+        char* json2;\
+        size_t length;\
+        opt.canonical = 1;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
+        json2 = lept_stringify_ex(&v, &length, &opt);\
+        EXPECT_EQ_STRING(expect, json2, length);\
+        lept_free(&v);\
+        free(json2);\
+    } while(0)
+
 static void test_stringify_number(){
     TEST_ROUNDTRIP("0");
     TEST_ROUNDTRIP("-0");
@@ -423,6 +701,7 @@ static void test_stringify_object() {
     TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
 }
 
+/* twice, the second time with hashes cached */
 #define TEST_EQUAL(json1, json2, equality)\
     do{\
         lept_value v1, v2;\
@@ -431,11 +710,17 @@ static void test_stringify_object() {
         EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v1, json1));\
         EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v2, json2));\
         EXPECT_EQ_INT(equality, lept_is_equal(&v1, &v2));\
+        h1 = lept_hash(&v1);\
+        h2 = lept_hash(&v2);\
+        if (equality)\
+            EXPECT_EQ_SIZE_T(h1, h2);\
+        EXPECT_EQ_INT(equality, lept_is_equal(&v1, &v2));\
         lept_free(&v1);\
         lept_free(&v2);\
     } while(0)
 
 static void test_equal() {
+    size_t h1, h2;
     TEST_EQUAL("true", "true", 1);
     TEST_EQUAL("true", "false", 0);
     TEST_EQUAL("false", "false", 1);
@@ -461,6 +746,66 @@ static void test_equal() {
     TEST_EQUAL("{\"a\":{\"b\":{\"c\":{}}}}", "{\"a\":{\"b\":{\"c\":[]}}}", 0);
 }
 
+/* cached hashes go stale with every change, a deep one included */
+static void test_hash() {
+    lept_value v, v1, v2, *e;
+    lept_init(&v);
+    lept_init(&v1);
+    lept_init(&v2);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v1, "{\"a\":[1,{\"b\":[2]}],\"c\":\"s\"}"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v2, "{\"c\":\"s\",\"a\":[1,{\"b\":[3]}]}"));
+    EXPECT_TRUE(lept_hash(&v1) != lept_hash(&v2));
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    e = lept_get_array_element(lept_find_object_value(lept_get_array_element(lept_find_object_value(&v2, "a", 1), 1), "b", 1), 0);
+    lept_set_number(e, 2);
+    EXPECT_TRUE(lept_is_equal(&v1, &v2));
+    EXPECT_EQ_SIZE_T(lept_hash(&v1), lept_hash(&v2));
+
+    lept_set_number(lept_pushback_array_element(lept_find_object_value(&v1, "a", 1)), 4);
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    lept_popback_array_element(lept_find_object_value(&v1, "a", 1));
+    EXPECT_TRUE(lept_is_equal(&v1, &v2));
+
+    lept_hash(&v1);
+    lept_set_object_value(&v1, "d", 1);
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    lept_hash(&v1);
+    lept_remove_object_value(&v1, lept_find_object_index(&v1, "d", 1));
+    EXPECT_TRUE(lept_is_equal(&v1, &v2));
+
+    lept_hash(&v1);
+    e = lept_get_array_element(lept_find_object_value(&v1, "a", 1), 0);
+    lept_swap(e, lept_find_object_value(&v1, "c", 1));
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    lept_hash(&v1);
+    lept_swap(e, lept_find_object_value(&v1, "c", 1));
+    EXPECT_TRUE(lept_is_equal(&v1, &v2));
+
+    lept_hash(&v1);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(lept_find_object_value(&v1, "c", 1), "[\"s\"]"));
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    lept_free(&v1);
+    lept_free(&v2);
+
+    /* a pointer taken before the hash was cached, and changes in place by a patch */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v1, "[[1,{\"b\":2}]]"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v2, "[[1,{\"b\":2}]]"));
+    e = lept_get_array_element(lept_get_array_element(&v1, 0), 0);
+    EXPECT_EQ_SIZE_T(lept_hash(&v1), lept_hash(&v2));
+    lept_set_number(e, 3);
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    lept_set_number(e, 1);
+    EXPECT_TRUE(lept_is_equal(&v1, &v2));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, "[{\"op\":\"replace\",\"path\":\"/0/1/b\",\"value\":3}]"));
+    lept_hash(&v2);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_patch_apply(&v2, &v));
+    EXPECT_FALSE(lept_is_equal(&v1, &v2));
+    EXPECT_TRUE(lept_hash(&v1) != lept_hash(&v2));
+    lept_free(&v);
+    lept_free(&v1);
+    lept_free(&v2);
+}
+
 static void test_copy() {
     lept_value v1, v2;
     lept_init(&v1);
@@ -472,6 +817,44 @@ static void test_copy() {
     lept_free(&v2);
 }
 
+/* RFC 8785 and its number serialization samples */
+static void test_stringify_canonical() {
+    TEST_CANONICAL("0", "0");
+    TEST_CANONICAL("0", "-0");
+    TEST_CANONICAL("0.1", "0.1");
+    TEST_CANONICAL("4.5", "4.50");
+    TEST_CANONICAL("0.002", "2e-3");
+    TEST_CANONICAL("0.000001", "1e-6");
+    TEST_CANONICAL("1e-7", "1e-7");
+    TEST_CANONICAL("1e-27", "0.000000000000000000000000001");
+    TEST_CANONICAL("333333333.3333333", "333333333.33333329");
+    TEST_CANONICAL("100000000000000000000", "1e20");
+    TEST_CANONICAL("1e+21", "1e21");
+    TEST_CANONICAL("1e+23", "1E23");
+    TEST_CANONICAL("1.5e+300", "15e299");
+    TEST_CANONICAL("9007199254740992", "9007199254740992");
+    TEST_CANONICAL("295147905179352830000", "295147905179352825856");
+    TEST_CANONICAL("1.7976931348623157e+308", "1.7976931348623157e308");
+    TEST_CANONICAL("5e-324", "4.9406564584124654e-324");
+    TEST_CANONICAL("-5e-324", "-4.9406564584124654e-324");
+    TEST_CANONICAL("-1.25", "-1.25");
+
+    TEST_CANONICAL("\"\\u001f\\n/\xe2\x82\xac\"", "\"\\u001F\\u000a\\/\\u20ac\"");
+    TEST_CANONICAL("{\"literals\":[null,true,false],\"numbers\":[333333333.3333333,1e+30,4.5,0.002,1e-27],"
+        "\"string\":\"\xe2\x82\xac$\\u000f\\nA'B\\\"\\\\\\\\\\\"/\"}",
+        "{\"numbers\":[333333333.33333329,1E30,4.50,2e-3,0.000000000000000000000000001],"
+        "\"string\":\"\\u20ac$\\u000F\\u000aA'\\u0042\\u0022\\u005c\\\\\\\"\\/\",\"literals\":[null,true,false]}");
+    /* UTF-16 order: the emoji (a surrogate pair) sorts before U+FB33 */
+    TEST_CANONICAL("{\"\\r\":1,\"1\":2,\"\xc2\x80\":3,\"\xc3\xb6\":4,\"\xe2\x82\xac\":5,\"\xf0\x9f\x98\x80\":6,\"\xef\xac\xb3\":7}",
+        "{\"\\u20ac\":5,\"\\r\":1,\"\\ufb33\":7,\"1\":2,\"\\ud83d\\ude00\":6,\"\\u0080\":3,\"\\u00f6\":4}");
+    TEST_CANONICAL("{\"a\":{\"x\":[{\"b\":1,\"c\":2}],\"y\":1},\"aa\":0,\"b\":[]}",
+        "{\"b\":[],\"aa\":0,\"a\":{\"y\":1,\"x\":[{\"c\":2,\"b\":1}]}}");
+    TEST_CANONICAL("{\"k00\":0,\"k01\":1,\"k02\":2,\"k03\":3,\"k04\":4,\"k05\":5,\"k06\":6,\"k07\":7,\"k08\":8,\"k09\":9,"
+        "\"k10\":10,\"k11\":11,\"k12\":12,\"k13\":13,\"k14\":14,\"k15\":15,\"k16\":16}",
+        "{\"k16\":16,\"k15\":15,\"k14\":14,\"k13\":13,\"k12\":12,\"k11\":11,\"k10\":10,\"k09\":9,\"k08\":8,"
+        "\"k07\":7,\"k06\":6,\"k05\":5,\"k04\":4,\"k03\":3,\"k02\":2,\"k01\":1,\"k00\":0}");
+}
+
 static void test_stringify() {
     TEST_ROUNDTRIP("null");
     TEST_ROUNDTRIP("false");
@@ -482,6 +865,173 @@ static void test_stringify() {
     test_stringify_object();
 }
 
+static size_t alloc_live, alloc_calls;
+
+static void* counting_alloc(void* ud, size_t size) { (void)ud; alloc_live++; alloc_calls++; return malloc(size); }
+static void* counting_realloc(void* ud, void* p, size_t size) { (void)ud; alloc_live += p == NULL; alloc_calls++; return realloc(p, size); }
+static void counting_free(void* ud, void* p) { (void)ud; alloc_live -= p != NULL; free(p); }
+
+static void test_allocator() {
+    static const lept_allocator counting = { counting_alloc, counting_realloc, counting_free, NULL };
+    const char* json = "{\"a\":[1,2,3,\"a string that is not inline\"],\"k00\":0,\"k01\":1,\"k02\":2,\"k03\":3,\"k04\":4,"
+        "\"k05\":5,\"k06\":6,\"k07\":7,\"k08\":8,\"k09\":9,\"k10\":10,\"k11\":11,\"k12\":12,\"k13\":13,\"k14\":14,\"k15\":15}";
+    lept_parse_options opt = { 0 };
+    lept_pool* pool;
+    lept_value v, *e;
+    char* json2;
+    size_t length, calls;
+
+    /* global: everything goes through it and comes back */
+    lept_set_allocator(&counting);
+    EXPECT_TRUE(lept_get_allocator() == &counting);
+    alloc_live = alloc_calls = 0;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+    EXPECT_TRUE(alloc_live > 0);
+    e = lept_find_object_value(&v, "a", 1);
+    lept_set_string(lept_pushback_array_element(e), "another string that is not inline", 33);
+    EXPECT_EQ_DOUBLE(15.0, lept_get_number(lept_find_object_value(&v, "k15", 3)));
+    calls = alloc_calls;
+    json2 = lept_stringify(&v, &length);   // result buffer is plain malloc()
+    EXPECT_EQ_SIZE_T(calls, alloc_calls);
+    free(json2);
+    lept_free(&v);
+    EXPECT_EQ_SIZE_T(0, alloc_live);
+    lept_set_allocator(NULL);
+    EXPECT_TRUE(lept_get_allocator() != &counting);
+
+    /* an indexed object shrunk to nothing takes its key index with it */
+    lept_set_allocator(&counting);
+    alloc_live = 0;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+    EXPECT_EQ_DOUBLE(15.0, lept_get_number(lept_find_object_value(&v, "k15", 3)));
+    while (lept_get_object_size(&v) > 0)
+        lept_remove_object_value(&v, 0);
+    lept_shrink_object(&v);
+    EXPECT_EQ_SIZE_T(0, lept_get_object_capacity(&v));
+    EXPECT_EQ_SIZE_T(0, alloc_live);
+    lept_free(&v);
+    lept_set_allocator(NULL);
+
+    /* per parse: the global allocator isn't touched, not even by the lazy key index */
+    lept_set_allocator(&counting);
+    alloc_live = alloc_calls = 0;
+    pool = lept_pool_create(256);
+    opt.allocator = lept_pool_allocator(pool);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, json, &opt));
+    EXPECT_EQ_DOUBLE(15.0, lept_get_number(lept_find_object_value(&v, "k15", 3)));
+    EXPECT_EQ_STRING("a string that is not inline", lept_get_string(lept_get_array_element(lept_find_object_value(&v, "a", 1), 3)), 27);
+    lept_free_ex(&v, opt.allocator);
+    EXPECT_EQ_SIZE_T(0, alloc_calls);
+    lept_set_allocator(NULL);
+
+    /* changes and frees go back to the allocator that made the value, whatever is current then */
+    alloc_live = 0;
+    opt.allocator = &counting;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, json, &opt));
+    lept_set_string(lept_set_object_value(&v, "k16", 3), "a string that is not inline", 27);
+    lept_remove_object_value(&v, lept_find_object_index(&v, "k00", 3));
+    lept_set_string(lept_get_array_element(lept_find_object_value(&v, "a", 1), 3), "", 0);
+    EXPECT_TRUE(alloc_live > 0);
+    lept_free(&v);
+    EXPECT_EQ_SIZE_T(0, alloc_live);
+    opt.allocator = lept_pool_allocator(pool);
+
+    /* pool reuse, and errors leave nothing behind that matters */
+    lept_pool_reset(pool);
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, lept_parse_ex(&v, "{\"a\":[\"a string that is not inline\"] x", &opt));
+    lept_pool_reset(pool);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, json, &opt));
+    EXPECT_EQ_SIZE_T(17, lept_get_object_size(&v));
+    lept_pool_destroy(pool);
+}
+
+static void test_allocator_slab() {
+    const char* json = "{\"a\":[1,2,3,\"a string that is not inline\"],\"o\":{\"x\":\"y\"}}";
+    lept_value v, ref, *a, *o;
+    char key[16], s[600];
+    size_t i;
+    memset(s, 'x', sizeof(s));
+    lept_init(&ref);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&ref, json));
+
+    lept_set_allocator(lept_slab_allocator());
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+    a = lept_find_object_value(&v, "a", 1);
+    o = lept_find_object_value(&v, "o", 1);
+    /* every size class and the large path, grown, shrunk and moved between classes */
+    for (i = 0; i < 600; i++) {
+        lept_set_string(lept_pushback_array_element(a), s, i);
+        sprintf(key, "k%u", (unsigned)i);
+        lept_set_number(lept_set_object_value(o, key, strlen(key)), (double)i);
+    }
+    for (i = 0; i < 600; i++) {
+        EXPECT_EQ_SIZE_T(i, lept_get_string_length(lept_get_array_element(a, 4 + i)));
+        sprintf(key, "k%u", (unsigned)i);
+        EXPECT_EQ_DOUBLE((double)i, lept_get_number(lept_find_object_value(o, key, strlen(key))));
+    }
+    lept_erase_array_element(a, 4, 600);
+    for (i = 0; i < 600; i++) {
+        sprintf(key, "k%u", (unsigned)i);
+        lept_remove_object_value(o, lept_find_object_index(o, key, strlen(key)));
+    }
+    lept_shrink_array(a);
+    lept_shrink_object(o);
+    EXPECT_TRUE(lept_is_equal(&ref, &v));
+    lept_free(&v);
+    lept_slab_flush();
+    lept_set_allocator(NULL);
+    lept_free(&ref);
+}
+
+static void test_context_cache() {
+    const char* json = "{\"a\":[1,2,3,\"a string that is not inline\"],\"o\":{\"x\":[[[\"y\"]]]}}";
+    static const lept_allocator counting = { counting_alloc, counting_realloc, counting_free, NULL };
+    lept_value v, big;
+    char* out;
+    size_t i, length;
+    lept_init(&big);
+    lept_set_array(&big, 0);
+    for (i = 0; i < 2000; i++)
+        lept_set_number(lept_pushback_array_element(&big), (double)i);
+
+    lept_set_context_cache(1024);
+    for (i = 0; i < 10; i++) {
+        lept_init(&v);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+        out = lept_stringify(&v, &length);
+        EXPECT_EQ_SIZE_T(strlen(json), length);
+        EXPECT_TRUE(strcmp(json, out) == 0);
+        free(out);
+        lept_free(&v);
+        /* stacks above the limit are freed, not kept */
+        out = lept_stringify(&big, &length);
+        lept_init(&v);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, out));
+        EXPECT_TRUE(lept_is_equal(&big, &v));
+        free(out);
+        lept_free(&v);
+    }
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_parse(&v, "[\"a\",\"b\""));
+    lept_thread_cleanup();
+
+    /* cached stacks come from the global allocator and go back to it */
+    lept_set_allocator(&counting);
+    alloc_live = alloc_calls = 0;
+    for (i = 0; i < 3; i++) {
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+        out = lept_stringify(&v, &length);
+        free(out);
+        lept_free(&v);
+    }
+    EXPECT_TRUE(alloc_live > 0);
+    lept_thread_cleanup();
+    EXPECT_EQ_SIZE_T(0, alloc_live);
+    lept_set_allocator(NULL);
+    lept_set_context_cache(0);
+    lept_free(&big);
+}
+
 static void test_move() {
     lept_value v1, v2, v3;
     lept_init(&v1);
@@ -550,6 +1100,36 @@ static void test_access_string(){
     lept_free(&v);
 }
 
+static void test_value_layout(){
+#ifdef LEPT_COMPACT_VALUE
+    if (sizeof(void*) == 8)
+        EXPECT_EQ_SIZE_T((size_t)16, sizeof(lept_value));
+#endif
+    EXPECT_TRUE(sizeof(lept_value) <= 3 * sizeof(void*));
+}
+
+static void test_access_short_string(){
+    /* strings around the inline (SSO) capacity boundary */
+    char buf[LEPT_SSO_CAPACITY + 2];
+    size_t len;
+    lept_value v, v2;
+    memset(buf, 'x', sizeof(buf));
+    lept_init(&v);
+    lept_init(&v2);
+    for (len = LEPT_SSO_CAPACITY - 1; len <= LEPT_SSO_CAPACITY + 1; len++){
+        lept_set_string(&v, buf, len);
+        EXPECT_EQ_SIZE_T(len, lept_get_string_length(&v));
+        EXPECT_TRUE(memcmp(buf, lept_get_string(&v), len) == 0);
+        EXPECT_TRUE(lept_get_string(&v)[len] == '\0');
+        lept_copy(&v2, &v);
+        EXPECT_TRUE(lept_is_equal(&v, &v2));
+    }
+    lept_set_string(&v, "\0a", 2);
+    EXPECT_EQ_STRING("\0a", lept_get_string(&v), lept_get_string_length(&v));
+    lept_free(&v);
+    lept_free(&v2);
+}
+
 static void test_access_array() {
     lept_value a, e;
     size_t i, j;
@@ -592,14 +1172,12 @@ static void test_access_array() {
     for (i = 0; i < 6; i++)
         EXPECT_EQ_DOUBLE((double)i + 2, lept_get_number(lept_get_array_element(&a, i)));
 
-#if 0
     for (i = 0; i < 2; i++) {
         lept_init(&e);
         lept_set_number(&e, i);
         lept_move(lept_insert_array_element(&a, i), &e);
         lept_free(&e);
     }
-#endif
     
     EXPECT_EQ_SIZE_T(8, lept_get_array_size(&a));
     for (i = 0; i < 8; i++)
@@ -626,8 +1204,35 @@ static void test_access_array() {
     lept_free(&a);
 }
 
+static void test_access_array_range() {
+    lept_value a, *e;
+    size_t i;
+
+    lept_init(&a);
+    lept_set_array(&a, 0);
+    e = lept_append_array_elements(&a, 1000);
+    for (i = 0; i < 1000; i++)
+        lept_set_number(&e[i], (double)i);
+    EXPECT_EQ_SIZE_T(1000, lept_get_array_size(&a));
+    EXPECT_TRUE(lept_get_array_capacity(&a) >= 1000);
+
+    e = lept_insert_array_elements(&a, 10, 3);
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&e[0]));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&e[2]));
+    EXPECT_EQ_DOUBLE(10.0, lept_get_number(lept_get_array_element(&a, 13)));
+    lept_erase_array_element(&a, 10, 3);
+    EXPECT_EQ_SIZE_T(1000, lept_get_array_size(&a));
+    for (i = 0; i < 1000; i++)
+        EXPECT_TRUE((double)i == lept_get_number(lept_get_array_element(&a, i)));
+
+    lept_set_string(lept_pushback_array_element(&a), "a string longer than inline", 27);
+    lept_erase_array_element(&a, 0, 1000);
+    EXPECT_EQ_SIZE_T(1, lept_get_array_size(&a));
+    EXPECT_EQ_INT(LEPT_STRING, lept_get_type(lept_get_array_element(&a, 0)));
+    lept_free(&a);
+}
+
 static void test_access_object() {
-#if 0
     lept_value o, v, *pv;
     size_t i, j, index;
 
@@ -696,7 +1301,762 @@ static void test_access_object() {
     EXPECT_EQ_SIZE_T(0, lept_get_object_capacity(&o));
 
     lept_free(&o);
-#endif
+}
+
+static void test_access_object_index() {
+    lept_value o, *pv;
+    char key[16];
+    size_t i, n = 20000;
+
+    lept_init(&o);
+    lept_set_object(&o, 0);
+    for (i = 0; i < n; i++){
+        sprintf(key, "k%u", (unsigned)i);
+        lept_set_number(lept_set_object_value(&o, key, strlen(key)), (double)i);
+    }
+    EXPECT_EQ_SIZE_T(n, lept_get_object_size(&o));
+    /* setting an existing key doesn't add a member */
+    lept_set_number(lept_set_object_value(&o, "k7", 2), -7.0);
+    EXPECT_EQ_SIZE_T(n, lept_get_object_size(&o));
+    EXPECT_EQ_DOUBLE(-7.0, lept_get_number(lept_find_object_value(&o, "k7", 2)));
+
+    /* swap-remove every even key, order-preserving remove a few odd ones */
+    for (i = 0; i < n; i += 2){
+        sprintf(key, "k%u", (unsigned)i);
+        lept_swap_remove_object_value(&o, lept_find_object_index(&o, key, strlen(key)));
+    }
+    lept_remove_object_value(&o, lept_find_object_index(&o, "k1", 2));
+    lept_remove_object_value(&o, lept_find_object_index(&o, "k99", 3));
+    EXPECT_EQ_SIZE_T(n / 2 - 2, lept_get_object_size(&o));
+    for (i = 0; i < n; i++){
+        sprintf(key, "k%u", (unsigned)i);
+        pv = lept_find_object_value(&o, key, strlen(key));
+        if (i % 2 == 0 || i == 1 || i == 99)
+            EXPECT_TRUE(pv == NULL);
+        else
+            EXPECT_TRUE(pv != NULL && lept_get_number(pv) == (double)(i == 7 ? -7 : (int)i));
+    }
+    lept_free(&o);
+
+    /* duplicated keys from the parser: lookups find the first one */
+    lept_init(&o);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&o, "{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,"
+        "\"g\":7,\"h\":8,\"i\":9,\"j\":10,\"k\":11,\"l\":12,\"m\":13,\"n\":14,\"o\":15,\"a\":16}"));
+    EXPECT_EQ_DOUBLE(1.0, lept_get_number(lept_find_object_value(&o, "a", 1)));
+    lept_swap_remove_object_value(&o, 0);
+    EXPECT_EQ_DOUBLE(16.0, lept_get_number(lept_find_object_value(&o, "a", 1)));
+    lept_free(&o);
+
+    /* built up front for shared documents, nested ones included */
+    lept_init(&o);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&o, "[{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,"
+        "\"g\":7,\"h\":8,\"i\":9,\"j\":10,\"k\":11,\"l\":12,\"m\":13,\"n\":14,\"o\":15,\"a\":16},[]]"));
+    lept_build_index(&o);
+    pv = lept_get_array_element(&o, 0);
+    EXPECT_EQ_DOUBLE(1.0, lept_get_number(lept_find_object_value(pv, "a", 1)));
+    EXPECT_EQ_DOUBLE(15.0, lept_get_number(lept_find_object_value(pv, "o", 1)));
+    EXPECT_TRUE(lept_find_object_value(pv, "p", 1) == NULL);
+    lept_set_number(lept_set_object_value(pv, "p", 1), 17.0);
+    EXPECT_EQ_DOUBLE(17.0, lept_get_number(lept_find_object_value(pv, "p", 1)));
+    lept_build_index(&o);
+    EXPECT_EQ_SIZE_T(16, lept_find_object_index(pv, "p", 1));
+    lept_free(&o);
+}
+
+#define TEST_POINTER(doc, ptr, expect_json)\
+    do {\
+        lept_pointer* p = lept_pointer_compile(ptr);\
+        lept_value* pv;\
+        lept_value e;\
+        EXPECT_TRUE(p != NULL);\
+        pv = lept_pointer_get(doc, p);\
+        lept_init(&e);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&e, expect_json));\
+        EXPECT_TRUE(pv != NULL && lept_is_equal(pv, &e));\
+        lept_free(&e);\
+        lept_pointer_free(p);\
+    } while(0)
+
+static void test_pointer() {
+    /* RFC 6901 section 5 */
+    static const char* batch[] = { "/a~1b", "/foo/1", "/foo/9", "", "/foo/0", "/nope/x", "/m~0n" };
+    lept_value doc, *out[7];
+    lept_pointer* p;
+    lept_pointer_batch* b;
+    lept_init(&doc);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&doc, "{\"foo\": [\"bar\", \"baz\"], \"\": 0, \"a/b\": 1,"
+        "\"c%d\": 2, \"e^f\": 3, \"g|h\": 4, \"i\\\\j\": 5, \"k\\\"l\": 6, \" \": 7, \"m~n\": 8}"));
+    TEST_POINTER(&doc, "/foo", "[\"bar\", \"baz\"]");
+    TEST_POINTER(&doc, "/foo/0", "\"bar\"");
+    TEST_POINTER(&doc, "/", "0");
+    TEST_POINTER(&doc, "/a~1b", "1");
+    TEST_POINTER(&doc, "/c%d", "2");
+    TEST_POINTER(&doc, "/i\\j", "5");
+    TEST_POINTER(&doc, "/k\"l", "6");
+    TEST_POINTER(&doc, "/ ", "7");
+    TEST_POINTER(&doc, "/m~0n", "8");
+    EXPECT_TRUE(lept_pointer_get(&doc, p = lept_pointer_compile("")) == &doc);
+    lept_pointer_free(p);
+
+    p = lept_pointer_compile("/foo/-");
+    EXPECT_TRUE(lept_pointer_get(&doc, p) == NULL);
+    lept_pointer_free(p);
+    p = lept_pointer_compile("/foo/01");
+    EXPECT_TRUE(lept_pointer_get(&doc, p) == NULL);
+    lept_pointer_free(p);
+    EXPECT_TRUE(lept_pointer_compile("foo") == NULL);
+    EXPECT_TRUE(lept_pointer_compile("/a~2") == NULL);
+    EXPECT_TRUE(lept_pointer_compile("/a~") == NULL);
+
+    b = lept_pointer_batch_compile(batch, 7);
+    EXPECT_TRUE(b != NULL);
+    lept_pointer_batch_get(&doc, b, out);
+    EXPECT_EQ_DOUBLE(1.0, lept_get_number(out[0]));
+    EXPECT_EQ_STRING("baz", lept_get_string(out[1]), lept_get_string_length(out[1]));
+    EXPECT_TRUE(out[2] == NULL);
+    EXPECT_TRUE(out[3] == &doc);
+    EXPECT_EQ_STRING("bar", lept_get_string(out[4]), lept_get_string_length(out[4]));
+    EXPECT_TRUE(out[5] == NULL);
+    EXPECT_EQ_DOUBLE(8.0, lept_get_number(out[6]));
+    lept_pointer_batch_free(b);
+    lept_free(&doc);
+}
+
+#define TEST_QUERY(doc, path, expect_json)\
+    do {\
+        lept_query* q = lept_query_compile(path);\
+        lept_query_result r = { NULL, 0, 0 };\
+        lept_value got, e;\
+        size_t i;\
+        EXPECT_TRUE(q != NULL);\
+        lept_init(&got);\
+        lept_init(&e);\
+        lept_set_array(&got, 0);\
+        for (i = lept_query_run(doc, q, &r); i > 0; i--)\
+            lept_copy(lept_pushback_array_element(&got), r.v[r.size - i]);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&e, expect_json));\
+        EXPECT_TRUE(lept_is_equal(&got, &e));\
+        lept_free(&got);\
+        lept_free(&e);\
+        lept_query_result_free(&r);\
+        lept_query_free(q);\
+    } while(0)
+
+static void test_query() {
+    lept_value doc;
+    lept_init(&doc);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&doc, "{\"store\":{"
+        "\"book\":["
+        "{\"category\":\"reference\",\"author\":\"Nigel Rees\",\"price\":8.95},"
+        "{\"category\":\"fiction\",\"author\":\"Evelyn Waugh\",\"price\":12.99},"
+        "{\"category\":\"fiction\",\"author\":\"Herman Melville\",\"isbn\":\"0-553-21311-3\",\"price\":8.99},"
+        "{\"category\":\"fiction\",\"author\":\"J. R. R. Tolkien\",\"isbn\":\"0-395-19395-8\",\"price\":22.99}],"
+        "\"bicycle\":{\"color\":\"red\",\"price\":19.95}}}"));
+    TEST_QUERY(&doc, "$.store.book[*].author", "[\"Nigel Rees\",\"Evelyn Waugh\",\"Herman Melville\",\"J. R. R. Tolkien\"]");
+    TEST_QUERY(&doc, "$..author", "[\"Nigel Rees\",\"Evelyn Waugh\",\"Herman Melville\",\"J. R. R. Tolkien\"]");
+    TEST_QUERY(&doc, "$.store..price", "[8.95,12.99,8.99,22.99,19.95]");
+    TEST_QUERY(&doc, "$['store']['bicycle'].color", "[\"red\"]");
+    TEST_QUERY(&doc, "$..book[2].author", "[\"Herman Melville\"]");
+    TEST_QUERY(&doc, "$..book[-1].price", "[22.99]");
+    TEST_QUERY(&doc, "$..book[:2].price", "[8.95,12.99]");
+    TEST_QUERY(&doc, "$..book[1:].price", "[12.99,8.99,22.99]");
+    TEST_QUERY(&doc, "$..book[::-2].price", "[22.99,12.99]");
+    /* steps past the end of the slice stop instead of overflowing */
+    TEST_QUERY(&doc, "$..book[1:5:9223372036854775807].price", "[12.99]");
+    TEST_QUERY(&doc, "$..book[-9223372036854775807:9223372036854775807:9223372036854775807].price", "[8.95]");
+    TEST_QUERY(&doc, "$..book[2::-9223372036854775808].price", "[8.99]");
+    TEST_QUERY(&doc, "$..book[?(@.isbn)].price", "[8.99,22.99]");
+    TEST_QUERY(&doc, "$..book[?(@.price < 10)].author", "[\"Nigel Rees\",\"Herman Melville\"]");
+    TEST_QUERY(&doc, "$.store.book[?(@.category == 'reference')].price", "[8.95]");
+    TEST_QUERY(&doc, "$.store.book[?(@.category != \"fiction\")].price", "[8.95]");
+    TEST_QUERY(&doc, "$.store.bicycle.*", "[\"red\",19.95]");
+    TEST_QUERY(&doc, "$.nope[*]", "[]");
+    TEST_QUERY(&doc, "$", "[{\"store\":{\"book\":[{\"category\":\"reference\",\"author\":\"Nigel Rees\",\"price\":8.95},"
+        "{\"category\":\"fiction\",\"author\":\"Evelyn Waugh\",\"price\":12.99},"
+        "{\"category\":\"fiction\",\"author\":\"Herman Melville\",\"isbn\":\"0-553-21311-3\",\"price\":8.99},"
+        "{\"category\":\"fiction\",\"author\":\"J. R. R. Tolkien\",\"isbn\":\"0-395-19395-8\",\"price\":22.99}],"
+        "\"bicycle\":{\"color\":\"red\",\"price\":19.95}}}]");
+    lept_free(&doc);
+
+    /* an index only matches in arrays, a name only in objects */
+    lept_init(&doc);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&doc, "[[1],{\"a\":1,\"0\":1},[{\"a\":1}]]"));
+    TEST_QUERY(&doc, "$[?(@[0] == 1)]", "[[1]]");
+    TEST_QUERY(&doc, "$[?(@.a == 1)]", "[{\"a\":1,\"0\":1}]");
+    TEST_QUERY(&doc, "$[?(@['0'])]", "[{\"a\":1,\"0\":1}]");
+    TEST_QUERY(&doc, "$[?(@[0].a)]", "[[{\"a\":1}]]");
+    EXPECT_TRUE(lept_query_compile("store") == NULL);
+    EXPECT_TRUE(lept_query_compile("$.") == NULL);
+    EXPECT_TRUE(lept_query_compile("$[") == NULL);
+    EXPECT_TRUE(lept_query_compile("$[?(@.a ==)]") == NULL);
+    lept_free(&doc);
+}
+
+#define TEST_PROJECTION(fs, json, expect)\
+    do {\
+        lept_parse_options opt = { 0 };\
+        lept_value v;\
+        char* json2;\
+        size_t length;\
+        opt.fields = fs;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, json, &opt));\
+        json2 = lept_stringify(&v, &length);\
+        EXPECT_EQ_STRING(expect, json2, length);\
+        lept_free(&v);\
+        free(json2);\
+    } while(0)
+
+#define TEST_PROJECTION_ERROR(fs, error, json)\
+    do {\
+        lept_parse_options opt = { 0 };\
+        lept_value v;\
+        opt.fields = fs;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(error, lept_parse_ex(&v, json, &opt));\
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));\
+        EXPECT_EQ_INT(error, lept_parse(&v, json));\
+    } while(0)
+
+static void test_parse_projection() {
+    static const char* paths[] = { "/user/id", "/items/*/price", "/meta", "/tags/1" };
+    lept_fieldset* fs = lept_fieldset_compile(paths, 4);
+    EXPECT_TRUE(fs != NULL);
+    TEST_PROJECTION(fs,
+        "{ \"user\" : { \"name\" : \"a\\u00e9\", \"id\" : 42, \"x\" : [1, {\"}\" : \"]\"}] },"
+        "  \"skip\" : { \"deep\" : [[[\"\\\"\"]]] }, \"n\" : -1.5e+10,"
+        "  \"items\" : [ { \"price\" : 1, \"q\" : 2 }, { \"q\" : 3 }, 7 ],"
+        "  \"meta\" : { \"v\" : [true, null] },"
+        "  \"tags\" : [ \"a\", \"b\", \"c\", \"d\" ] }",
+        "{\"user\":{\"id\":42},\"items\":[{\"price\":1},{},null],\"meta\":{\"v\":[true,null]},\"tags\":[null,\"b\"]}");
+    TEST_PROJECTION(fs, "[1, 2]", "[]");
+    TEST_PROJECTION(fs, "\"scalar\"", "null");
+
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_QUOTATION_MARK, "{\"skip\":\"abc");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"skip\":{\"a\":1");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "{\"skip\":[1,2");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_INVALID_VALUE, "{\"skip\":]");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"user\":{\"id\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_ROOT_NOT_SINGULAR, "{\"user\":{\"id\":1}} x");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_INVALID_VALUE, "{\"user\":{\"id\":nul}}");
+    lept_fieldset_free(fs);
+
+    /* skipped values are held to the full grammar */
+    fs = lept_fieldset_compile(paths + 2, 1);
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "{\"skip\":[1,2},\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"skip\":{\"a\":1],\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_INVALID_VALUE, "{\"skip\":tru,\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_INVALID_VALUE, "{\"skip\":[1.],\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "{\"skip\":[01],\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_NUMBER_TOO_BIG, "{\"skip\":1e309,\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_NUMBER_TOO_BIG, "{\"skip\":1e18446744073709551620,\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_NUMBER_TOO_BIG, "{\"skip\":[{\"a\":1e18446744073709551620}],\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_KEY, "{\"skip\":{1:2},\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_MISS_COLON, "{\"skip\":{\"a\" 2},\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_INVALID_STRING_ESCAPE, "{\"skip\":\"\\x\",\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_INVALID_UNICODE_SURROGATE, "{\"skip\":\"\\uD800\",\"meta\":1}");
+    TEST_PROJECTION_ERROR(fs, LEPT_PARSE_INVALID_STRING_CHAR, "{\"skip\":[\"\x01\"],\"meta\":1}");
+    lept_fieldset_free(fs);
+
+    {
+        static const char* bad[] = { "/ok", "no-slash" };
+        EXPECT_TRUE(lept_fieldset_compile(bad, 2) == NULL);
+    }
+}
+
+typedef struct {
+    long long ts;
+    char tag[8];
+} test_meta;
+
+typedef struct {
+    int id;
+    int active;
+    double score;
+    char* name;
+    test_meta meta;
+    lept_value extra;
+} test_user;
+
+static const lept_field_desc test_meta_desc[] = {
+    LEPT_FIELD("ts", test_meta, ts, LEPT_FIELD_INT64),
+    LEPT_FIELD("tag", test_meta, tag, LEPT_FIELD_CHARS),
+    LEPT_FIELD_END
+};
+
+static const lept_field_desc test_user_desc[] = {
+    LEPT_FIELD("id", test_user, id, LEPT_FIELD_INT),
+    LEPT_FIELD("active", test_user, active, LEPT_FIELD_BOOL),
+    LEPT_FIELD("score", test_user, score, LEPT_FIELD_DOUBLE),
+    LEPT_FIELD("name", test_user, name, LEPT_FIELD_STRING),
+    LEPT_FIELD_NESTED("meta", test_user, meta, test_meta_desc),
+    LEPT_FIELD("extra", test_user, extra, LEPT_FIELD_VALUE),
+    LEPT_FIELD_END
+};
+
+#define TEST_STRUCT_ERROR(s, error, json)\
+    do {\
+        test_user u;\
+        memset(&u, 0, sizeof(u));\
+        EXPECT_EQ_INT(error, lept_parse_struct(&u, json, s));\
+        lept_free_struct(&u, s);\
+    } while(0)
+
+static void test_parse_struct() {
+    lept_schema* s = lept_schema_compile(test_user_desc);
+    test_user u;
+    memset(&u, 0, sizeof(u));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_struct(&u,
+        " { \"id\" : 42, \"unknown\" : { \"id\" : [1, \"}\"] }, \"name\" : \"J\\u00f6rg\","
+        " \"active\" : true, \"score\" : 1.5e2, \"meta\" : { \"tag\" : \"abc\", \"ts\" : 1700000000123 },"
+        " \"extra\" : [null, {\"a\":1}], \"name\" : \"Bob\" } ", s));
+    EXPECT_EQ_INT(42, u.id);
+    EXPECT_EQ_INT(1, u.active);
+    EXPECT_EQ_DOUBLE(150.0, u.score);
+    EXPECT_EQ_STRING("Bob", u.name, strlen(u.name));
+    EXPECT_TRUE(u.meta.ts == 1700000000123LL);
+    EXPECT_EQ_STRING("abc", u.meta.tag, strlen(u.meta.tag));
+    EXPECT_EQ_INT(LEPT_ARRAY, lept_get_type(&u.extra));
+    EXPECT_EQ_SIZE_T(2, lept_get_array_size(&u.extra));
+    lept_free_struct(&u, s);
+    EXPECT_TRUE(u.name == NULL);
+
+    memset(&u, 0, sizeof(u));
+    u.id = 7;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_struct(&u, "{\"id\":null,\"meta\":{}}", s));
+    EXPECT_EQ_INT(7, u.id);
+    lept_free_struct(&u, s);
+
+    {
+        /* round trip: struct -> json -> struct */
+        char* json;
+        size_t length;
+        test_user u2;
+        memset(&u, 0, sizeof(u));
+        u.id = -3;
+        u.score = 0.25;
+        u.name = "quote\" \\ \n";
+        strcpy(u.meta.tag, "t1");
+        u.meta.ts = -9007199254740993LL;
+        json = lept_stringify_struct(&u, s, &length);
+        EXPECT_EQ_STRING("{\"id\":-3,\"active\":false,\"score\":0.25,\"name\":\"quote\\\" \\\\ \\n\","
+            "\"meta\":{\"ts\":-9007199254740993,\"tag\":\"t1\"},\"extra\":null}", json, length);
+        memset(&u2, 0, sizeof(u2));
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_struct(&u2, json, s));
+        EXPECT_EQ_INT(-3, u2.id);
+        EXPECT_EQ_STRING("quote\" \\ \n", u2.name, strlen(u2.name));
+        EXPECT_EQ_STRING("t1", u2.meta.tag, strlen(u2.meta.tag));
+        EXPECT_TRUE(u2.meta.ts == -9007199254740993LL);
+        lept_free_struct(&u2, s);
+        free(json);
+    }
+
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "[]");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"id\":\"42\"}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"id\":1.5}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"id\":1e20}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"id\":2147483648}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"id\":-2147483649}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"meta\":{\"ts\":1e19}}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"active\":1}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"meta\":{\"tag\":\"12345678\"}}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_SCHEMA_MISMATCH, "{\"meta\":[]}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_MISS_COLON, "{\"name\" \"x\"}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"name\":\"x\"");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_ROOT_NOT_SINGULAR, "{\"name\":\"x\"} 1");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_INVALID_STRING_ESCAPE, "{\"name\":\"\\x\"}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_EXPECT_VALUE, " ");
+    /* unknown members are skipped, but still have to be well-formed */
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_INVALID_VALUE, "{\"x\":[},\"id\":1}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "{\"x\":[1},\"id\":1}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_INVALID_VALUE, "{\"x\":tru,\"id\":1}");
+    TEST_STRUCT_ERROR(s, LEPT_PARSE_INVALID_STRING_ESCAPE, "{\"x\":{\"\\q\":1},\"id\":1}");
+    lept_schema_free(s);
+}
+
+#define TEST_CBOR_ROUNDTRIP(json)\
+    do {\
+        lept_value v, v2;\
+        unsigned char* bin;\
+        size_t length;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
+        bin = lept_cbor_encode(&v, &length);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_cbor_decode(&v2, bin, length));\
+        EXPECT_TRUE(lept_is_equal(&v, &v2));\
+        lept_free(&v);\
+        lept_free(&v2);\
+        free(bin);\
+    } while(0)
+
+#define TEST_CBOR_ENCODE(expect, json)\
+    do {\
+        lept_value v;\
+        unsigned char* bin;\
+        size_t length;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
+        bin = lept_cbor_encode(&v, &length);\
+        EXPECT_EQ_SIZE_T(sizeof(expect) - 1, length);\
+        EXPECT_TRUE(memcmp(expect, bin, length) == 0);\
+        lept_free(&v);\
+        free(bin);\
+    } while(0)
+
+#define TEST_CBOR_DECODE(json, bin)\
+    do {\
+        lept_value v;\
+        char* json2;\
+        size_t length;\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_cbor_decode(&v, (const unsigned char*)bin, sizeof(bin) - 1));\
+        json2 = lept_stringify(&v, &length);\
+        EXPECT_EQ_STRING(json, json2, length);\
+        lept_free(&v);\
+        free(json2);\
+    } while(0)
+
+#define TEST_CBOR_ERROR(error, bin)\
+    do {\
+        lept_value v;\
+        EXPECT_EQ_INT(error, lept_cbor_decode(&v, (const unsigned char*)bin, sizeof(bin) - 1));\
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));\
+    } while(0)
+
+static void test_cbor() {
+    /* RFC 8949 Appendix A */
+    TEST_CBOR_ENCODE("\x00", "0");
+    TEST_CBOR_ENCODE("\x17", "23");
+    TEST_CBOR_ENCODE("\x18\x18", "24");
+    TEST_CBOR_ENCODE("\x19\x03\xe8", "1000");
+    TEST_CBOR_ENCODE("\x1a\x00\x0f\x42\x40", "1000000");
+    TEST_CBOR_ENCODE("\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00", "1000000000000");
+    TEST_CBOR_ENCODE("\x20", "-1");
+    TEST_CBOR_ENCODE("\x38\x63", "-100");
+    TEST_CBOR_ENCODE("\x3b\x01\x63\x45\x78\x5d\x89\xff\xff", "-1e17");
+    TEST_CBOR_ENCODE("\x3b\xff\xff\xff\xff\xff\xff\xff\xff", "-18446744073709551616");
+    TEST_CBOR_ENCODE("\x3b\xff\xff\xff\xff\xff\xff\xf7\xff", "-18446744073709549568");
+    TEST_CBOR_ENCODE("\xfb\xc3\xf0\x00\x00\x00\x00\x00\x01", "-18446744073709555712");
+    TEST_CBOR_ENCODE("\xfa\x3f\xc0\x00\x00", "1.5");
+    TEST_CBOR_ENCODE("\xfa\x80\x00\x00\x00", "-0.0");
+    TEST_CBOR_ENCODE("\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a", "1.1");
+    TEST_CBOR_ENCODE("\xf4", "false");
+    TEST_CBOR_ENCODE("\xf5", "true");
+    TEST_CBOR_ENCODE("\xf6", "null");
+    TEST_CBOR_ENCODE("\x60", "\"\"");
+    TEST_CBOR_ENCODE("\x64\x49\x45\x54\x46", "\"IETF\"");
+    TEST_CBOR_ENCODE("\x80", "[]");
+    TEST_CBOR_ENCODE("\x83\x01\x82\x02\x03\x82\x04\x05", "[1,[2,3],[4,5]]");
+    TEST_CBOR_ENCODE("\xa2\x61\x61\x01\x61\x62\x82\x02\x03", "{\"a\":1,\"b\":[2,3]}");
+
+    TEST_CBOR_DECODE("1.5", "\xf9\x3e\x00");
+    TEST_CBOR_DECODE("65504", "\xf9\x7b\xff");
+    TEST_CBOR_DECODE("5.9604644775390625e-08", "\xf9\x00\x01");
+    TEST_CBOR_DECODE("-1.8446744073709552e+19", "\x3b\xff\xff\xff\xff\xff\xff\xff\xff");
+    TEST_CBOR_DECODE("null", "\xf7");
+    TEST_CBOR_DECODE("\"\\u0001\\u0002\"", "\x42\x01\x02");
+    TEST_CBOR_DECODE("1363896240", "\xc1\x1a\x51\x4b\x67\xb0");
+    TEST_CBOR_DECODE("{\"a\":1,\"a\":2}", "\xa2\x61\x61\x01\x61\x61\x02");
+
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "");
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "\x18");
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "\x64\x49\x45");
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "\x9f\x01\xff");
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "\x83\x01\x02");
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "\x9b\xff\xff\xff\xff\xff\xff\xff\xff");
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "\xa1\x01\x02");
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "\xa2\x61\x61\x01\x61\x62");
+    TEST_CBOR_ERROR(LEPT_PARSE_INVALID_CBOR, "\xf8\x20");
+    TEST_CBOR_ERROR(LEPT_PARSE_ROOT_NOT_SINGULAR, "\x01\x02");
+
+    TEST_CBOR_ROUNDTRIP("[null,false,true,0,-0,1e300,-1.5e-300,4294967296,-9007199254740993,\"\\u0000x\",\"Hello World\\n\"]");
+    TEST_CBOR_ROUNDTRIP("[9007199254740994,-9007199254740994,1e17,-1e17,-18446744073709549568,-18446744073709551616,-1e20]");
+    TEST_CBOR_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
+}
+
+static int snode_equal(const lept_snode* s, const lept_value* v) {
+    size_t i;
+    if (lept_snode_get_type(s) != lept_get_type(v))
+        return 0;
+    switch (lept_get_type(v)) {
+        case LEPT_NUMBER:
+            return lept_snode_get_number(s) == lept_get_number(v);
+        case LEPT_STRING:
+            return lept_snode_get_string_length(s) == lept_get_string_length(v) &&
+                memcmp(lept_snode_get_string(s), lept_get_string(v), lept_get_string_length(v) + 1) == 0;
+        case LEPT_ARRAY:
+            if (lept_snode_get_array_size(s) != lept_get_array_size(v))
+                return 0;
+            for (i = 0; i < lept_get_array_size(v); i++)
+                if (!snode_equal(lept_snode_get_array_element(s, i), lept_get_array_element(v, i)))
+                    return 0;
+            return 1;
+        case LEPT_OBJECT:
+            if (lept_snode_get_object_size(s) != lept_get_object_size(v))
+                return 0;
+            for (i = 0; i < lept_get_object_size(v); i++)
+                if (lept_snode_get_object_key_length(s, i) != lept_get_object_key_length(v, i) ||
+                    memcmp(lept_snode_get_object_key(s, i), lept_get_object_key(v, i), lept_get_object_key_length(v, i) + 1) != 0 ||
+                    !snode_equal(lept_snode_get_object_value(s, i), lept_get_object_value(v, i)))
+                    return 0;
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+static void test_snapshot() {
+    const char* path = "test_snapshot.tmp";
+    lept_snapshot snap;
+    const lept_snode* root, *s;
+    lept_value v;
+    FILE* fp;
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, "{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"a\\u0000b\","
+        "\"e\":\"\",\"a\":[1,[],{},[2,\"x\"]],\"o\":{\"zeta\":1,\"alpha\":2,\"mid\":3,\"alpha\":4,\"\":5}}"));
+    EXPECT_EQ_INT(0, lept_snapshot_write(&v, path));
+    EXPECT_EQ_INT(0, lept_snapshot_open(&snap, path));
+    root = lept_snapshot_root(&snap);
+    EXPECT_TRUE(snode_equal(root, &v));
+    EXPECT_EQ_SIZE_T(1, lept_snode_find_object_index(root, "f", 1));
+    EXPECT_TRUE(lept_snode_get_boolean(lept_snode_find_object_value(root, "t", 1)));
+    EXPECT_EQ_DOUBLE(123.0, lept_snode_get_number(lept_snode_find_object_value(root, "i", 1)));
+    EXPECT_EQ_STRING("a\0b", lept_snode_get_string(lept_snode_find_object_value(root, "s", 1)), 3);
+    EXPECT_TRUE(lept_snode_find_object_value(root, "x", 1) == NULL);
+    EXPECT_TRUE(lept_snode_find_object_value(root, "ss", 2) == NULL);
+    s = lept_snode_find_object_value(root, "o", 1);
+    EXPECT_EQ_SIZE_T(0, lept_snode_find_object_index(s, "zeta", 4));
+    EXPECT_EQ_SIZE_T(1, lept_snode_find_object_index(s, "alpha", 5));
+    EXPECT_EQ_SIZE_T(2, lept_snode_find_object_index(s, "mid", 3));
+    EXPECT_EQ_SIZE_T(4, lept_snode_find_object_index(s, "", 0));
+    EXPECT_EQ_SIZE_T(LEPT_KEY_NOT_EXIST, lept_snode_find_object_index(s, "alph", 4));
+    EXPECT_EQ_SIZE_T(LEPT_KEY_NOT_EXIST, lept_snode_find_object_index(s, "zz", 2));
+    s = lept_snode_get_array_element(lept_snode_find_object_value(root, "a", 1), 3);
+    EXPECT_EQ_STRING("x", lept_snode_get_string(lept_snode_get_array_element(s, 1)), 1);
+    lept_snapshot_close(&snap);
+    lept_free(&v);
+
+    /* scalar root */
+    lept_set_number(&v, 2.5);
+    EXPECT_EQ_INT(0, lept_snapshot_write(&v, path));
+    EXPECT_EQ_INT(0, lept_snapshot_open(&snap, path));
+    EXPECT_EQ_DOUBLE(2.5, lept_snode_get_number(lept_snapshot_root(&snap)));
+    lept_snapshot_close(&snap);
+
+    /* not a snapshot */
+    fp = fopen(path, "wb");
+    fputs("{\"this is\":\"json, not a snapshot file\"}", fp);
+    fclose(fp);
+    EXPECT_EQ_INT(-1, lept_snapshot_open(&snap, path));
+    remove(path);
+    EXPECT_EQ_INT(-1, lept_snapshot_open(&snap, path));
+}
+
+#define TEST_DIFF(expect, from, to)\
+    do {\
+        lept_value a, b, p, e;\
+        lept_init(&a);\
+        lept_init(&b);\
+        lept_init(&p);\
+        lept_init(&e);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&a, from));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&b, to));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&e, expect));\
+        lept_diff(&p, &a, &b);\
+        EXPECT_TRUE(lept_is_equal(&e, &p));\
+        lept_free(&a);\
+        lept_free(&b);\
+        lept_free(&p);\
+        lept_free(&e);\
+    } while(0)
+
+static void test_diff() {
+    lept_value a, b, p;
+    char key[16];
+    size_t i;
+    TEST_DIFF("[]", "{\"a\":[1,{\"b\":null}]}", "{\"a\":[1,{\"b\":null}]}");
+    TEST_DIFF("[{\"op\":\"replace\",\"path\":\"\",\"value\":2}]", "1", "2");
+    TEST_DIFF("[{\"op\":\"replace\",\"path\":\"\",\"value\":false}]", "true", "false");
+    TEST_DIFF("[{\"op\":\"replace\",\"path\":\"/a\",\"value\":{\"x\":1}}]", "{\"a\":[1]}", "{\"a\":{\"x\":1}}");
+
+    /* objects */
+    TEST_DIFF("[{\"op\":\"replace\",\"path\":\"/b\",\"value\":5},{\"op\":\"remove\",\"path\":\"/c\"},{\"op\":\"add\",\"path\":\"/d\",\"value\":4}]",
+        "{\"a\":1,\"b\":2,\"c\":3}", "{\"b\":5,\"a\":1,\"d\":4}");
+    TEST_DIFF("[{\"op\":\"replace\",\"path\":\"/a~1b/m~0n\",\"value\":\"y\"}]",
+        "{\"a/b\":{\"m~n\":\"x\"}}", "{\"a/b\":{\"m~n\":\"y\"}}");
+    TEST_DIFF("[{\"op\":\"replace\",\"path\":\"/n\",\"value\":2}]",
+        "{\"t\":{\"a\":[1,{\"b\":2}],\"c\":3},\"n\":1}", "{\"n\":2,\"t\":{\"c\":3,\"a\":[1,{\"b\":2}]}}");
+
+    /* arrays */
+    TEST_DIFF("[{\"op\":\"add\",\"path\":\"/1\",\"value\":4}]", "[1,2,3]", "[1,4,2,3]");
+    TEST_DIFF("[{\"op\":\"remove\",\"path\":\"/2\"},{\"op\":\"remove\",\"path\":\"/1\"}]", "[1,2,3,4]", "[1,4]");
+    TEST_DIFF("[{\"op\":\"add\",\"path\":\"/0\",\"value\":1},{\"op\":\"add\",\"path\":\"/1\",\"value\":2}]", "[]", "[1,2]");
+    TEST_DIFF("[{\"op\":\"replace\",\"path\":\"/0\",\"value\":0},{\"op\":\"remove\",\"path\":\"/2\"},{\"op\":\"add\",\"path\":\"/4\",\"value\":6}]",
+        "[1,2,3,4,5]", "[0,2,4,5,6]");
+    TEST_DIFF("[{\"op\":\"replace\",\"path\":\"/0/v\",\"value\":2}]",
+        "[{\"id\":1,\"v\":1},{\"id\":2}]", "[{\"id\":1,\"v\":2},{\"id\":2}]");
+    TEST_DIFF("[{\"op\":\"remove\",\"path\":\"/0\"},{\"op\":\"add\",\"path\":\"/1\",\"value\":[1]}]",
+        "[[1],{\"k\":[2,3]}]", "[{\"k\":[2,3]},[1]]");
+
+    /* big objects are matched through the key index, big arrays by position */
+    lept_init(&a);
+    lept_set_object(&a, 0);
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "k%u", (unsigned)i);
+        lept_set_number(lept_set_object_value(&a, key, strlen(key)), (double)i);
+    }
+    lept_init(&b);
+    lept_copy(&b, &a);
+    lept_set_string(lept_find_object_value(&b, "k42", 3), "x", 1);
+    lept_init(&p);
+    lept_diff(&p, &a, &b);
+    EXPECT_EQ_SIZE_T(1, lept_get_array_size(&p));
+    EXPECT_EQ_STRING("/k42", lept_get_string(lept_find_object_value(lept_get_array_element(&p, 0), "path", 4)), 4);
+    lept_set_array(&a, 0);
+    lept_set_array(&b, 0);
+    for (i = 0; i < 2000; i++) {
+        lept_set_number(lept_pushback_array_element(&a), (double)i);
+        lept_set_number(lept_pushback_array_element(&b), (double)(i % 2 ? i : i + 1));
+    }
+    lept_diff(&p, &a, &b);
+    EXPECT_EQ_SIZE_T(1000, lept_get_array_size(&p));
+    lept_free(&a);
+    lept_free(&b);
+    lept_free(&p);
+}
+
+#define TEST_PATCH(expect, json, patch)\
+    do {\
+        lept_value d, p, e;\
+        lept_init(&d);\
+        lept_init(&p);\
+        lept_init(&e);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&d, json));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&p, patch));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&e, expect));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_patch_apply(&d, &p));\
+        EXPECT_TRUE(lept_is_equal(&e, &d));\
+        lept_free(&d);\
+        lept_free(&p);\
+        lept_free(&e);\
+    } while(0)
+
+/* a failed patch leaves the document as it was, member order included */
+#define TEST_PATCH_ERROR(error, json, patch)\
+    do {\
+        lept_value d, p;\
+        char* json2;\
+        size_t length;\
+        lept_init(&d);\
+        lept_init(&p);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&d, json));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&p, patch));\
+        EXPECT_EQ_INT(error, lept_patch_apply(&d, &p));\
+        json2 = lept_stringify(&d, &length);\
+        EXPECT_EQ_STRING(json, json2, length);\
+        lept_free(&d);\
+        lept_free(&p);\
+        free(json2);\
+    } while(0)
+
+#define TEST_MERGE_PATCH(expect, json, patch)\
+    do {\
+        lept_value d, p;\
+        char* json2;\
+        size_t length;\
+        lept_init(&d);\
+        lept_init(&p);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&d, json));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&p, patch));\
+        lept_merge_patch(&d, &p);\
+        json2 = lept_stringify(&d, &length);\
+        EXPECT_EQ_STRING(expect, json2, length);\
+        lept_free(&d);\
+        lept_free(&p);\
+        free(json2);\
+    } while(0)
+
+static void test_patch() {
+    static const char* docs[][2] = {
+        { "{\"a\":[1,2,3,{\"x\":[true,null]}],\"b\":\"s\"}", "{\"b\":\"t\",\"a\":[0,2,{\"x\":[null]},3,4],\"c\":{}}" },
+        { "[[1,2],[3],[],{\"k\":1}]", "[[2,1],{\"k\":2},[3],[]]" },
+        { "{\"a\":1}", "[\"a\"]" },
+    };
+    lept_value a, b, p;
+    size_t i;
+
+    /* RFC 6902 appendix A */
+    TEST_PATCH("{\"baz\":\"qux\",\"foo\":\"bar\"}", "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]");
+    TEST_PATCH("{\"foo\":[\"bar\",\"qux\",\"baz\"]}", "{\"foo\":[\"bar\",\"baz\"]}", "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]");
+    TEST_PATCH("{\"foo\":\"bar\"}", "{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"remove\",\"path\":\"/baz\"}]");
+    TEST_PATCH("{\"foo\":[\"bar\",\"baz\"]}", "{\"foo\":[\"bar\",\"qux\",\"baz\"]}", "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]");
+    TEST_PATCH("{\"baz\":\"boo\",\"foo\":\"bar\"}", "{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]");
+    TEST_PATCH("{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"corge\":\"grault\",\"thud\":\"fred\"}}",
+        "{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},\"qux\":{\"corge\":\"grault\"}}",
+        "[{\"op\":\"move\",\"from\":\"/foo/waldo\",\"path\":\"/qux/thud\"}]");
+    TEST_PATCH("{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}", "{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}",
+        "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]");
+    TEST_PATCH("{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}", "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+        "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2}]");
+    TEST_PATCH("{\"foo\":\"bar\",\"child\":{\"grandchild\":{}}}", "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/child\",\"value\":{\"grandchild\":{}}}]");
+    TEST_PATCH("{\"foo\":[\"bar\",[\"abc\",\"def\"]]}", "{\"foo\":[\"bar\"]}", "[{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":[\"abc\",\"def\"]}]");
+    TEST_PATCH("{\"foo\":[1,2],\"bar\":[1,2]}", "{\"foo\":[1,2]}", "[{\"op\":\"copy\",\"from\":\"/foo\",\"path\":\"/bar\"}]");
+    TEST_PATCH("{\"a/b\":{\"m~n\":2}}", "{\"a/b\":{\"m~n\":1}}", "[{\"op\":\"replace\",\"path\":\"/a~1b/m~0n\",\"value\":2}]");
+    TEST_PATCH("[1]", "{\"a\":1}", "[{\"op\":\"replace\",\"path\":\"\",\"value\":[1]}]");
+    TEST_PATCH("{\"a\":{\"a\":1}}", "{\"a\":1}", "[{\"op\":\"copy\",\"from\":\"\",\"path\":\"/a\"}]");
+    TEST_PATCH("{\"b\":2}", "{\"a\":1,\"b\":2}", "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a\"},{\"op\":\"remove\",\"path\":\"/a\"}]");
+
+    TEST_PATCH_ERROR(LEPT_PARSE_INVALID_PATCH, "{\"a\":1}", "{}");
+    TEST_PATCH_ERROR(LEPT_PARSE_INVALID_PATCH, "{\"a\":1}", "[{\"op\":\"add\",\"path\":\"/b\"}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_INVALID_PATCH, "{\"a\":1}", "[{\"op\":\"add\",\"path\":\"b\",\"value\":1}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_INVALID_PATCH, "{\"a\":1}", "[{\"op\":\"jump\",\"path\":\"/a\",\"value\":1}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_INVALID_PATCH, "{\"a\":1}", "[{\"op\":\"move\",\"path\":\"/a\"}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "{\"a\":1}", "[{\"op\":\"remove\",\"path\":\"/b\"}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "{\"a\":1}", "[{\"op\":\"remove\",\"path\":\"\"}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "{\"a\":1}", "[{\"op\":\"replace\",\"path\":\"/b\",\"value\":1}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "{\"a\":1}", "[{\"op\":\"add\",\"path\":\"/b/c\",\"value\":1}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "[1,2]", "[{\"op\":\"add\",\"path\":\"/3\",\"value\":1}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "[1,2]", "[{\"op\":\"add\",\"path\":\"/01\",\"value\":1}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "{\"a\":{\"b\":1}}", "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/b/c\"}]");
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "{\"baz\":\"qux\"}", "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]");
+
+    /* every kind of change is undone once a later operation fails */
+    TEST_PATCH_ERROR(LEPT_PARSE_PATCH_FAILED, "{\"a\":[1,2,3],\"b\":{\"x\":1,\"y\":2,\"z\":3},\"c\":\"s\"}",
+        "[{\"op\":\"add\",\"path\":\"/a/1\",\"value\":9},{\"op\":\"remove\",\"path\":\"/b/x\"},"
+        "{\"op\":\"replace\",\"path\":\"/c\",\"value\":[]},{\"op\":\"move\",\"from\":\"/b/y\",\"path\":\"/a/0\"},"
+        "{\"op\":\"move\",\"from\":\"/a/3\",\"path\":\"/b/z\"},{\"op\":\"copy\",\"from\":\"/b\",\"path\":\"/c/-\"},"
+        "{\"op\":\"add\",\"path\":\"/d\",\"value\":{\"e\":1}},{\"op\":\"remove\",\"path\":\"/a/0\"},"
+        "{\"op\":\"replace\",\"path\":\"\",\"value\":null},{\"op\":\"test\",\"path\":\"\",\"value\":1}]");
+
+    /* lept_diff output applies back */
+    for (i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+        lept_init(&a);
+        lept_init(&b);
+        lept_init(&p);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&a, docs[i][0]));
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&b, docs[i][1]));
+        lept_diff(&p, &a, &b);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_patch_apply(&a, &p));
+        EXPECT_TRUE(lept_is_equal(&a, &b));
+        lept_free(&a);
+        lept_free(&b);
+        lept_free(&p);
+    }
+
+    /* RFC 7396 appendix A */
+    TEST_MERGE_PATCH("{\"a\":\"c\"}", "{\"a\":\"b\"}", "{\"a\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":\"b\"}", "{\"b\":\"c\"}");
+    TEST_MERGE_PATCH("{}", "{\"a\":\"b\"}", "{\"a\":null}");
+    TEST_MERGE_PATCH("{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}");
+    TEST_MERGE_PATCH("{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":[\"b\"]}");
+    TEST_MERGE_PATCH("{\"a\":{\"b\":\"d\"}}", "{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}");
+    TEST_MERGE_PATCH("{\"a\":[1]}", "{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}");
+    TEST_MERGE_PATCH("[\"c\"]", "[\"a\",\"b\"]", "[\"c\"]");
+    TEST_MERGE_PATCH("null", "{\"a\":\"foo\"}", "null");
+    TEST_MERGE_PATCH("\"bar\"", "{\"a\":\"foo\"}", "\"bar\"");
+    TEST_MERGE_PATCH("{\"e\":null,\"a\":1}", "{\"e\":null}", "{\"a\":1}");
+    TEST_MERGE_PATCH("{\"a\":\"foo\"}", "[1,2]", "{\"a\":\"foo\",\"b\":null}");
+    TEST_MERGE_PATCH("{\"a\":{\"bb\":{}}}", "{}", "{\"a\":{\"bb\":{\"ccc\":null}}}");
 }
 
 static void test_access(){
@@ -704,18 +2064,33 @@ static void test_access(){
     test_access_boolean();
     test_access_number();
     test_access_string();
+    test_access_short_string();
+    test_value_layout();
     test_access_array();
+    test_access_array_range();
     test_access_object();
+    test_access_object_index();
 }
 
 int main(){
     test_parse();
     test_access();
     test_stringify();
+    test_stringify_canonical();
     test_equal();
+    test_hash();
     test_copy();
     test_move();
+    test_allocator();
+    test_allocator_slab();
+    test_context_cache();
     test_swap();
+    test_pointer();
+    test_query();
+    test_cbor();
+    test_snapshot();
+    test_diff();
+    test_patch();
     printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
     return main_ret;
 }
\ No newline at end of file